@@ -31,6 +31,91 @@ LIBMRS_DLLF int mrs_set_decryption(MRS* mrs, int where, MRS_ENCRYPTION_FUNC f);
 
 LIBMRS_DLLF int mrs_set_encryption(MRS* mrs, int where, MRS_ENCRYPTION_FUNC f);
 
+/**
+ * \brief Set the options of the `mrs` handle.
+ * \param mrs   `MRS` handle.
+ * \param flags Combination of `enum mrs_flag_t` values, replacing the current ones.
+ * \note With `MRSF_LAZY`, `MRSA_MRS` keeps the archive open and file buffers are only read from it when needed, instead
+ * of copying all of them to the temporary storage. A file is copied to the temporary storage once it is modified, or
+ * when the archive is about to be overwritten by `mrs_save`.
+ * \note `MRSF_MMAP` works like `MRSF_LAZY`, but maps the archive into memory, so processes opening the same archive
+ * share its pages and only the parts that are actually read are loaded. If the archive can't be mapped, it is read
+ * like `MRSF_LAZY` does.
+ * \note With `MRSF_TRUST_CDIR` (together with `MRSF_LAZY` or `MRSF_MMAP`), `MRSA_MRS` takes sizes and offsets from
+ * the central directory alone, so opening an archive is just reading its header and its central directory. The local
+ * header of a file (which tells where its buffer starts) is read and checked the first time the buffer is needed,
+ * so an archive with a bad local header is only detected then (reading that file fails).
+ * \note With `MRSF_MEMORY_STORAGE`, the temporary storage (where added and modified files are kept until saved) is
+ * moved to memory, so nothing touches the filesystem until `mrs_save`. Clearing it moves the storage back to a
+ * temporary file, if one can be created.
+ * \note With `MRSF_PREDICT`, files added or written to are stored (STORE) instead of deflated when they look compressed
+ * already: by their extension (.ogg, .mp3, .jpg, .png, ...), by how they start (their magic number), by how random
+ * their bytes are (a few samples of them), or because the first 512 KB barely got smaller when deflated. A file that
+ * doesn't get smaller at all is stored too. Files that do get deflated come out the same as without it.
+ */
+LIBMRS_DLLF int mrs_set_flags(MRS* mrs, int flags);
+
+/**
+ * \brief Sets how many threads read and compress files for `MRSA_FOLDER`.
+ * \param mrs     `MRS` handle.
+ * \param threads Number of threads, up to `64`. `0` or `1` (the default) does everything on the calling thread.
+ * \note Files are still added to `mrs` in the same order, with the same names and contents, as with a single thread,
+ * so the archive saved afterwards is the same byte for byte. Only reading and compressing (CRC32 and deflate) are
+ * spread over the threads, names are checked and buffers written to the temporary storage on the calling thread.
+ * \note Each thread is at most a few files ahead of the calling thread, so memory use stays bounded.
+ */
+LIBMRS_DLLF int mrs_set_threads(MRS* mrs, unsigned threads);
+
+/**
+ * \brief Sets how files added or written to from now on are compressed.
+ * \param mrs      `MRS` handle.
+ * \param level    From `MRSCL_FASTEST` (`1`) to `MRSCL_BEST` (`9`, the default), or `MRSCL_STORE` (`0`) to store files
+ *                 as they are.
+ * \param strategy One of `enum mrs_strategy_t`, `MRSCS_DEFAULT` is the default.
+ * \note Files added with `MRSA_MRS`, `MRSA_MRS2` and `MRSA_MRS_MEMORY` keep their buffers as they were in the archive,
+ * they're only compressed again once written to.
+ * \note A file can be compressed its own way with `mrs_set_file_info` and `MRSFI_COMPRESSION` (giving a
+ * `struct mrs_compression_t`, or `NULL` to go back to the handle's), which compresses it again right away and
+ * every time it is written to afterwards.
+ */
+LIBMRS_DLLF int mrs_set_compression(MRS* mrs, int level, int strategy);
+
+/**
+ * \brief Keeps what files are compressed to in directory `dir`, so the same contents aren't compressed again.
+ * \param mrs `MRS` handle.
+ * \param dir Directory of the cache, made if it doesn't exist. `NULL` stops using it.
+ * \note Entries are named after the contents of a file (not its name), the backend (`mrs_set_codec`), compression
+ * level and strategy, and `MRSF_PREDICT`, so rebuilding an archive from a folder where few files changed only
+ * compresses those. Files come out the same as without the cache.
+ * \note A directory can be shared by several handles, threads and processes. Nothing is ever deleted from it, the
+ * whole directory (or any entry) can be deleted at any time.
+ */
+LIBMRS_DLLF int mrs_set_compression_cache(MRS* mrs, const char* dir);
+
+/**
+ * \brief Sets the DEFLATE backend `mrs` compresses and inflates files with.
+ * \param mrs   `MRS` handle.
+ * \param codec `mrs_codec_zlib()` (the default, also when `NULL`), `mrs_codec_libdeflate()` or one of your own.
+ * \note Backends don't make the same compressed bytes, but what one makes any other reads back, so archives stay
+ * readable by GunZ and older versions of libmrs whichever is used. zlib-ng built in zlib compatible mode is used by
+ * simply linking it instead of zlib.
+ * \note The streaming readers (`mrs_entry_open`, `mrs_read_range`) always inflate with zlib.
+ */
+LIBMRS_DLLF int mrs_set_codec(MRS* mrs, const mrs_codec_t* codec);
+
+/**
+ * \brief The zlib backend, the default one.
+ */
+LIBMRS_DLLF const mrs_codec_t* mrs_codec_zlib();
+
+/**
+ * \brief The libdeflate backend, `NULL` unless libmrs was built with `LIBMRS_LIBDEFLATE` defined (and libdeflate).
+ * \note libdeflate deflates and inflates whole buffers a lot faster than zlib, and makes smaller files at the same level.
+ * It ignores `enum mrs_strategy_t` and doesn't give up early with `MRSF_PREDICT` (files that don't get smaller are
+ * still stored).
+ */
+LIBMRS_DLLF const mrs_codec_t* mrs_codec_libdeflate();
+
 /**
  * \brief Add an item, or items, to the `mrs` handle.
  * \param mrs      `MRS` handle to add items to.
@@ -52,6 +137,12 @@ LIBMRS_DLLF int mrs_set_encryption(MRS* mrs, int where, MRS_ENCRYPTION_FUNC f);
  * \note If `what` is `MRSA_MRS`, the variadic parameters are `const char* mrsname, const char* base_name`, where:
  * \note >>> `mrsname`   – Name of the MRS archive containing the files to be added.
  * \note >>> `base_name` – Same behavior as `base_name` parameter from `MRSA_FOLDER` parameters.
+ * \note ––––––––––––––––
+ * \note If `what` is `MRSA_MRS_MEMORY`, the variadic parameters are `const void* buffer, size_t size, const char* base_name`, where:
+ * \note >>> `buffer`    – The whole MRS archive, as it would be on disk. It is not copied: it has to stay valid for as
+ * long as files read from it are in `mrs` if `MRSF_LAZY` or `MRSF_MMAP` is set, otherwise only during the call.
+ * \note >>> `size`      – Size of `buffer`.
+ * \note >>> `base_name` – Same behavior as `base_name` parameter from `MRSA_FOLDER` parameters.
  */
 LIBMRS_DLLF int mrs_add(MRS* mrs, enum mrs_add_t what, enum mrs_dupe_behavior_t on_dupe, void* reserved, ...);
 
@@ -61,8 +152,131 @@ LIBMRS_DLLF int mrs_set_signature(MRS* mrs, int where, uint32_t signature);
 
 LIBMRS_DLLF int mrs_set_signature_check(MRS* mrs, MRS_SIGNATURE_FUNC f);
 
+/**
+ * \brief Reads the contents of a file.
+ * \param mrs      `MRS` handle.
+ * \param index    Index of the file.
+ * \param buf      Where to put the contents.
+ * \param buf_size Size of `buf`, must be at least the size of the file.
+ * \param out_size Receives the size of the file.
+ * \note Reading functions (`mrs_read`, `mrs_read_view`, `mrs_read_range`, `mrs_read_many`, `mrs_entry_*`) may be
+ * called from many threads at once on the same handle, as long as nothing changes the handle meanwhile.
+ */
 LIBMRS_DLLF int mrs_read(const MRS* mrs, unsigned index, unsigned char* buf, size_t buf_size, size_t* out_size);
 
+/**
+ * \brief Get a pointer to the contents of a file without copying them.
+ * \param mrs   `MRS` handle.
+ * \param index Index of the file.
+ * \param ptr   Receives a pointer to the contents of the file, which must not be modified.
+ * \param len   Receives the size of the file.
+ * \note Only available for files stored with no compression (STORE) that are kept in memory, that is, in a memory
+ * temporary storage, or in an archive opened with `MRSF_MMAP` that has no file buffer decryption. Otherwise returns
+ * `MRSE_UNSUPPORTED`, and `mrs_read` has to be used instead.
+ * \note The pointer is valid until `mrs` is modified (adding, writing or removing files, saving over the archive it
+ * came from, compacting the temporary storage) or freed.
+ */
+LIBMRS_DLLF int mrs_read_view(const MRS* mrs, unsigned index, const unsigned char** ptr, size_t* len);
+
+/**
+ * \brief Opens a stream to read the contents of a file a piece at a time.
+ * \param mrs   `MRS` handle.
+ * \param index Index of the file.
+ * \param entry Receives the stream, which must be closed with `mrs_entry_close`.
+ * \note Unlike `mrs_read`, neither the whole compressed nor the whole uncompressed file is ever held in memory,
+ * the compressed buffer is read (and decrypted) 64 KB at a time.
+ * \note The file buffer decryption function is called on pieces of the buffer, so it must work byte by byte (as
+ * `mrs_default_decrypt` does).
+ * \note The stream reads the file as it was when it was opened, it should not be used anymore after the file is
+ * written to or removed, after the temporary storage is compacted (`mrs_compact`), or after `mrs` is freed.
+ */
+LIBMRS_DLLF int mrs_entry_open(const MRS* mrs, unsigned index, MRS_ENTRY** entry);
+
+/**
+ * \brief Reads the next piece of the contents of a file.
+ * \param entry    Stream opened with `mrs_entry_open`.
+ * \param buf      Where to put the contents.
+ * \param buf_size Size of `buf`.
+ * \param out_size Receives how many bytes were put in `buf`, `0` once the whole file was read.
+ */
+LIBMRS_DLLF int mrs_entry_read(MRS_ENTRY* entry, unsigned char* buf, size_t buf_size, size_t* out_size);
+
+LIBMRS_DLLF int mrs_entry_close(MRS_ENTRY* entry);
+
+/**
+ * \brief Reads part of the contents of a file.
+ * \param mrs      `MRS` handle.
+ * \param index    Index of the file.
+ * \param offset   Where to start reading, in the uncompressed file.
+ * \param len      How many bytes to read.
+ * \param buf      Where to put the contents, must have at least `len` bytes.
+ * \param out_size Receives how many bytes were read, less than `len` if the file ends before.
+ * \note Reading a compressed file still means inflating it up to `offset`, for big files (over 1 MB) checkpoints
+ * are saved every 1 MB while doing it (and kept with the file until it is written to), so the next reads start
+ * inflating from the checkpoint right before `offset` instead of from the beginning.
+ * \note The file buffer decryption function must work byte by byte (as `mrs_default_decrypt` does).
+ */
+LIBMRS_DLLF int mrs_read_range(const MRS* mrs, unsigned index, size_t offset, size_t len, unsigned char* buf, size_t* out_size);
+
+/**
+ * \brief Enables a cache of uncompressed files, which `mrs_read` consults before reading (and inflating) a file.
+ * \param mrs    `MRS` handle.
+ * \param budget How many bytes the cached files may use, the least recently read ones are evicted to fit it.
+ *               `0` disables the cache and frees it.
+ * \note A file changed with `mrs_write` or removed is dropped from the cache.
+ */
+LIBMRS_DLLF int mrs_set_cache(MRS* mrs, size_t budget);
+
+/**
+ * \brief Keeps a file in the cache, reading it into the cache if it isn't there yet.
+ * \param mrs   `MRS` handle.
+ * \param index Index of the file.
+ * \param pin   `1` to pin the file, `0` to let it be evicted again.
+ * \note Pinned files are never evicted, even if they go over the budget. Returns `MRSE_UNSUPPORTED` if the cache
+ * isn't enabled.
+ */
+LIBMRS_DLLF int mrs_cache_pin(MRS* mrs, unsigned index, int pin);
+
+LIBMRS_DLLF int mrs_get_cache_stats(const MRS* mrs, struct mrs_cache_stats_t* stats);
+
+/**
+ * \brief Compacts the temporary storage: the buffers of the files kept there are moved next to each other, and the
+ * space left behind by files written, replaced or removed since is given back.
+ * \param mrs `MRS` handle.
+ * \note Files are moved, not read again or recompressed. If it fails, `mrs` is left as it was.
+ * \note Like writing a file, it ends pointers from `mrs_read_view` and streams from `mrs_entry_open` of files in the
+ * temporary storage. Cached files (`mrs_set_cache`) stay cached.
+ */
+LIBMRS_DLLF int mrs_compact(MRS* mrs);
+
+/**
+ * \brief Sets how much of the temporary storage (`percent`, from `0` to `100`) may be dead space, past that it is
+ * compacted on its own after adding, writing or removing files and after `MRSS_MRS_INCREMENTAL`. The default is `0`,
+ * which never compacts it on its own. Less than 1 MB of dead space is never compacted on its own either.
+ */
+LIBMRS_DLLF int mrs_set_compact_threshold(MRS* mrs, unsigned percent);
+
+/**
+ * \brief Tells how much of the temporary storage is used by files and how much is dead space.
+ * \param mrs   `MRS` handle.
+ * \param stats Receives the sizes.
+ */
+LIBMRS_DLLF int mrs_get_storage_stats(const MRS* mrs, struct mrs_storage_stats_t* stats);
+
+/**
+ * \brief Reads many files at once, giving each one to `sink` as soon as it is read.
+ * \param mrs     `MRS` handle.
+ * \param indices Indices of the files.
+ * \param count   How many indices there are.
+ * \param sink    Function that receives every file.
+ * \param param   Passed as is to `sink`.
+ * \note Files are read in order of where they are stored, not in order of `indices`, and file buffers that are next
+ * to each other are read with a single read (up to 4 MB), instead of one read per file as with `mrs_read`.
+ * Files already in the cache (see `mrs_set_cache`) are given first.
+ * \note The file buffer decryption function must work byte by byte (as `mrs_default_decrypt` does).
+ */
+LIBMRS_DLLF int mrs_read_many(const MRS* mrs, const unsigned* indices, size_t count, MRS_READ_FUNC sink, void* param);
+
 LIBMRS_DLLF int mrs_write(MRS* mrs, unsigned index, const unsigned char* buf, size_t buf_size);
 
 LIBMRS_DLLF int mrs_get_file_info(const MRS* mrs, unsigned index, enum mrs_file_info_t what, void* buf, size_t buf_size, size_t* out_size);
@@ -71,16 +285,177 @@ LIBMRS_DLLF int mrs_remove(MRS* mrs, unsigned index);
 
 LIBMRS_DLLF int mrs_set_file_info(MRS* mrs, unsigned index, enum mrs_file_info_t what, const void* buf, size_t buf_size);
 
+/**
+ * \brief Saves `mrs` as an archive (`MRSS_MRS`, `MRSS_MRS_INCREMENTAL`) or a folder (`MRSS_FOLDER`).
+ * \note With `MRSS_MRS_INCREMENTAL`, if `output` is an archive `mrs` still reads files from (added with `MRSA_MRS`
+ * and `MRSF_LAZY` or `MRSF_MMAP`), files that are unchanged there are left where they are. Only the others are
+ * written, after the end of the archive, followed by the central directory and the base header. So changing one file
+ * of a big archive writes that file, not the whole archive, and nothing of the archive is overwritten: if saving fails
+ * it's cut back to what it was. The base header is at the end though, so if the process dies while saving, the
+ * archive can't be opened until it's cut back to its old size. Files that aren't left in place and the old central directory leave their bytes
+ * behind as dead space. The archive is never made smaller, and if more than a set part of it would be dead space (see
+ * `mrs_set_incremental_threshold`), the whole archive is written as with `MRSS_MRS`.
+ * \note A file is left in place only if its local header would be written the same: same name, sizes, CRC32,
+ * signatures and encryption. The file buffer encryption (`mrs_set_encryption`) must be the one the archive was
+ * opened with (`mrs_set_decryption`).
+ * \note Without `MRSF_MMAP`, the files that were written are read from `output` afterwards, so the next incremental
+ * save leaves them in place too. With it, the mapping doesn't grow with the archive: they're read from where they
+ * were, and every incremental save writes them again (and leaves their last copy as dead space) until the archive
+ * is opened again.
+ */
 LIBMRS_DLLF int mrs_save(MRS* mrs, enum mrs_save_t type, const char* output, MRS_PROGRESS_FUNC pcallback);
 
+/**
+ * \brief Sets how much of an archive (`percent`, from `0` to `100`) may be dead space after `MRSS_MRS_INCREMENTAL`,
+ * past that the whole archive is written again. The default is `25`, `100` never writes it all again, `0` only when
+ * nothing would be dead.
+ */
+LIBMRS_DLLF int mrs_set_incremental_threshold(MRS* mrs, unsigned percent);
+
 LIBMRS_DLLF int mrs_save_mrs_fp(MRS* mrs, FILE* output, MRS_PROGRESS_FUNC pcallback);
 
+/**
+ * \brief Find a file by name.
+ * \param mrs   `MRS` handle.
+ * \param s     Name of the file, case doesn't matter and `\\` is the same as `/`.
+ * \param index Receives the index of the file (the first one, if more have the same name). Optional.
+ * \return `MRSE_OK` if found, `MRSE_NOT_FOUND` otherwise.
+ */
 LIBMRS_DLLF int mrs_find_file(const MRS* mrs, const char* s, unsigned* index);
 
+/**
+ * \brief Keeps a filter of the names of the files, so that most names that aren't there are ruled out right away.
+ * \param mrs           `MRS` handle.
+ * \param bits_per_name Size of the filter, up to `64`. `10` rules out about 99% of the names that aren't there, each
+ * extra `5` ten times fewer are let through. `0` drops the filter.
+ * \note It's a blocked Bloom filter: ruling a name out reads a single cache line of it, not the names themselves.
+ * `mrs_find_file`, and every add that checks for duplicates, go through it first. It's kept up to date as files are
+ * added, removed and renamed.
+ */
+LIBMRS_DLLF int mrs_set_name_filter(MRS* mrs, unsigned bits_per_name);
+
+/**
+ * \brief Saves the name filter of `mrs` (see `mrs_set_name_filter`) to a file, to load it instead of making it again.
+ */
+LIBMRS_DLLF int mrs_save_name_filter(const MRS* mrs, const char* filename);
+
+/**
+ * \brief Loads a name filter saved with `mrs_save_name_filter`, replacing the one of `mrs` (if any).
+ * \return `MRSE_OUTDATED` if it was saved for other names than the ones `mrs` has now, `MRSE_NOT_FOUND` if there is
+ * no such file, `MRSE_INVALID_PARAM` if it isn't a name filter.
+ * \note Telling if it's outdated takes no time: the handle keeps a sum of the hashes of its names as they come and go.
+ */
+LIBMRS_DLLF int mrs_load_name_filter(MRS* mrs, const char* filename);
+
+/**
+ * \brief Gives `sink` every file whose name starts with `prefix`, in order of name.
+ * \param mrs    `MRS` handle.
+ * \param prefix Start of the names, case doesn't matter and `\\` is the same as `/`. `NULL` or `""` lists all files.
+ * \param sink   Function that receives every file.
+ * \param param  Passed as is to `sink`.
+ * \note Files are kept in order of name as they are added, removed and renamed, so this takes as long as the number
+ * of files listed, not the number of files in `mrs`.
+ * \note `mrs` must not be changed from `sink`.
+ */
+LIBMRS_DLLF int mrs_list_prefix(const MRS* mrs, const char* prefix, MRS_LIST_FUNC sink, void* param);
+
+/**
+ * \brief Gives `sink` every file in the folder `dir`, in order of name.
+ * \param mrs       `MRS` handle.
+ * \param dir       Folder, with or without the `/` at the end. `NULL` or `""` is the root.
+ * \param recursive `1` to list the files in subfolders too, `0` to list only the ones right in `dir`.
+ * \param sink      Function that receives every file.
+ * \param param     Passed as is to `sink`.
+ * \note See `mrs_list_prefix`, subfolders skipped when not `recursive` take a single lookup each.
+ */
+LIBMRS_DLLF int mrs_list_dir(const MRS* mrs, const char* dir, int recursive, MRS_LIST_FUNC sink, void* param);
+
+/**
+ * \brief Gives `sink` every file whose name matches `pattern`, in order of name.
+ * \param mrs     `MRS` handle.
+ * \param pattern Pattern the whole name has to match, case doesn't matter and `\\` is the same as `/`:
+ * \note >>> `?`     – Any character but `/`.
+ * \note >>> `*`     – Any characters (none too) but `/`.
+ * \note >>> `**`    – Any characters (none too), `/` included. `**` followed by `/` is any number of whole folders,
+ * so `sfx/` + `**` + `/a.wav` matches both `"sfx/a.wav"` and `"sfx/ui/click/a.wav"`.
+ * \note >>> `[...]` – Any character of the set (`[abc]`, `[a-z]`), or any character but the ones of the set if it
+ * starts with `!` or `^`. Never matches `/`.
+ * \param sink    Function that receives every file.
+ * \param param   Passed as is to `sink`.
+ * \note Returns `MRSE_INVALID_PARAM` if a `[` has no `]`.
+ * \note Only the files whose names start with what `pattern` starts with (up to its first `?`, `*` or `[`) are
+ * checked, see `mrs_list_prefix`. `mrs` must not be changed from `sink`.
+ */
+LIBMRS_DLLF int mrs_find_glob(const MRS* mrs, const char* pattern, MRS_LIST_FUNC sink, void* param);
+
+/**
+ * \brief Gives `sink` every file whose name matches any of `patterns`, in order of name.
+ * \param mrs      `MRS` handle.
+ * \param patterns Patterns, see `mrs_find_glob`.
+ * \param count    How many patterns there are.
+ * \param sink     Function that receives every file, once even if it matches more than one pattern.
+ * \param param    Passed as is to `sink`.
+ * \note All the patterns are checked in one go over the names, each one only against the names it can match.
+ */
+LIBMRS_DLLF int mrs_find_globs(const MRS* mrs, const char* const* patterns, size_t count, MRS_LIST_FUNC sink, void* param);
+
 LIBMRS_DLLF size_t mrs_get_file_count(const MRS* mrs);
 
 LIBMRS_DLLF void mrs_free(MRS* mrs);
 
+/**
+ * \brief Frees what the calling thread keeps to (de)compress files.
+ * \note Every thread that reads or writes compressed files keeps its own zlib streams, set up on first use and reused
+ * for every file after. They are freed on their own when the thread exits, this frees them earlier, for a thread that
+ * is done with libmrs but goes on running.
+ */
+LIBMRS_DLLF void mrs_thread_cleanup();
+
+LIBMRS_DLLF MRS_VFS* mrs_vfs_init();
+
+/**
+ * \brief Mounts the files of a handle in the VFS.
+ * \param vfs         `MRS_VFS` handle.
+ * \param mrs         `MRS` handle, it is not copied and must not be changed or freed while mounted.
+ * \param mount_point Folder the files of `mrs` are in, in the VFS (`"model"` makes `"woman.elu"` be found as
+ * `"model/woman.elu"`). `NULL` or `""` is the root.
+ * \param priority    If more than one mounted handle has a file of the same name, the one with the highest `priority` is
+ * found, or the one mounted last among the same `priority`.
+ * \note Every file of every mounted handle is in a single hash table, so `mrs_vfs_find` is a single lookup however many
+ * handles are mounted. Mounting and unmounting only add and take out the files of that handle.
+ */
+LIBMRS_DLLF int mrs_vfs_mount(MRS_VFS* vfs, const MRS* mrs, const char* mount_point, int priority);
+
+/**
+ * \brief Opens a MRS archive and mounts it in the VFS, see `mrs_vfs_mount`.
+ * \param mrs Receives the handle the archive was opened in, to read through it or unmount it. Optional.
+ * \note The archive is opened with `MRSF_MMAP | MRSF_TRUST_CDIR` and default encryption, the handle is freed when it's
+ * unmounted or when `vfs` is freed. Archives with other encryption have to be opened and mounted with `mrs_vfs_mount`.
+ */
+LIBMRS_DLLF int mrs_vfs_mount_file(MRS_VFS* vfs, const char* mrsname, const char* mount_point, int priority, const MRS** mrs);
+
+LIBMRS_DLLF int mrs_vfs_unmount(MRS_VFS* vfs, const MRS* mrs);
+
+/**
+ * \brief Find a file by name among all the mounted handles.
+ * \param vfs   `MRS_VFS` handle.
+ * \param name  Name of the file in the VFS (mount point included), case doesn't matter and `\\` is the same as `/`.
+ * \param mrs   Receives the handle the file is in. Optional.
+ * \param index Receives the index of the file in that handle. Optional.
+ * \return `MRSE_OK` if found, `MRSE_NOT_FOUND` otherwise.
+ */
+LIBMRS_DLLF int mrs_vfs_find(const MRS_VFS* vfs, const char* name, const MRS** mrs, unsigned* index);
+
+/**
+ * \brief Reads the contents of a file found by name among all the mounted handles, see `mrs_vfs_find` and `mrs_read`.
+ */
+LIBMRS_DLLF int mrs_vfs_read(const MRS_VFS* vfs, const char* name, unsigned char* buf, size_t buf_size, size_t* out_size);
+
+/**
+ * \brief Frees the VFS, along with the handles opened by `mrs_vfs_mount_file`.
+ */
+LIBMRS_DLLF void mrs_vfs_free(MRS_VFS* vfs);
+
 LIBMRS_DLLF int mrs_global_verify(const char* filename, const struct mrs_encryption_t* decryption, MRS_SIGNATURE_FUNC sigcheck);
 
 LIBMRS_DLLF int mrs_global_compile(const char* name, const char* out_name, struct mrs_encryption_t* encryption, struct mrs_signature_t* sig, MRS_PROGRESS_FUNC pcallback);
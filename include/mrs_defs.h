@@ -42,7 +42,26 @@ enum mrs_add_t{
     /**< File from a file descriptor. */
     MRSA_FILEDES,
     /**< File from memory buffer. */
-    MRSA_MEMORY
+    MRSA_MEMORY,
+    /**< Files from a MRS archive in a memory buffer. */
+    MRSA_MRS_MEMORY
+};
+
+/**
+ * Options of a MRS handle, see `mrs_set_flags`.
+ */
+typedef enum mrs_flag_t mrs_flag_t;
+enum mrs_flag_t{
+    /**< `MRSA_MRS` only reads the headers, file buffers are read from the archive when needed. */
+    MRSF_LAZY = 0x01,
+    /**< Same as `MRSF_LAZY`, but the archive is mapped into memory (read-only) instead of read with `fread`. */
+    MRSF_MMAP = 0x02,
+    /**< With `MRSF_LAZY` or `MRSF_MMAP`, local headers are only read when their file buffer is needed. */
+    MRSF_TRUST_CDIR = 0x04,
+    /**< Temporary storage is kept in memory instead of a temporary file. */
+    MRSF_MEMORY_STORAGE = 0x08,
+    /**< Files that look compressed already are stored as they are, without deflating all of them first. */
+    MRSF_PREDICT = 0x10
 };
 
 /**
@@ -78,7 +97,64 @@ enum mrs_file_info_t{
     /**< Central Dir Header extra, returns a `unsigned char*`. */
     MRSFI_DHEXTRA,
     /**< Central Dir Header comment, returns a `unsigned char*`. */
-    MRSFI_DHCOMMENT
+    MRSFI_DHCOMMENT,
+    /**< How the file is compressed, returns a `struct mrs_compression_t`. */
+    MRSFI_COMPRESSION
+};
+
+/**
+ * Deflate strategies, the same as zlib's `Z_*` ones, see `mrs_set_compression`.
+ */
+typedef enum mrs_strategy_t mrs_strategy_t;
+enum mrs_strategy_t{
+    /**< For most files. */
+    MRSCS_DEFAULT = 0,
+    /**< For data made of small values that vary a bit (filtered images, for instance). */
+    MRSCS_FILTERED,
+    /**< No string matching, only Huffman coding. */
+    MRSCS_HUFFMAN_ONLY,
+    /**< Only matches runs of the same byte, almost as fast as `MRSCS_HUFFMAN_ONLY`, good for bitmaps. */
+    MRSCS_RLE,
+    /**< No dynamic Huffman codes, for small files. */
+    MRSCS_FIXED
+};
+
+/**< Compression level that stores files as they are (STORE), instead of deflating them */
+#define MRSCL_STORE   0
+/**< Fastest compression level */
+#define MRSCL_FASTEST 1
+/**< Compression level that makes the smallest files, the default */
+#define MRSCL_BEST    9
+
+/**
+ * How files are compressed, see `mrs_set_compression`.
+ */
+typedef struct mrs_compression_t mrs_compression_t;
+struct mrs_compression_t{
+    /**< From `MRSCL_STORE` (`0`) to `MRSCL_BEST` (`9`). */
+    int level;
+    /**< One of `enum mrs_strategy_t`. */
+    int strategy;
+};
+
+/**
+ * Raw DEFLATE backend files are compressed and inflated with, see `mrs_set_codec`.
+ * Whatever one backend deflates, any other must inflate to the same bytes.
+ */
+typedef struct mrs_codec_t mrs_codec_t;
+struct mrs_codec_t{
+    /**< Name of the backend, "zlib", "libdeflate", ... */
+    const char* name;
+    /**
+     * Deflates `in` into `out` (raw DEFLATE, no zlib or gzip wrapper) at `level` (`MRSCL_FASTEST` to `MRSCL_BEST`) with
+     * `strategy` (one of `enum mrs_strategy_t`, it may be ignored), returns the compressed size, `0` if it fails or the
+     * result doesn't fit in `out_size` bytes. If `probe` isn't `0`, it may give up (returning `0`) when the first
+     * `probe` bytes don't get down to `probe_ratio`% of their size or less.
+     */
+    size_t (*deflate)(const unsigned char* in, size_t in_size, unsigned char* out, size_t out_size,
+                      int level, int strategy, size_t probe, unsigned probe_ratio);
+    /**< Inflates raw DEFLATE `in` into `out`, returns `0` only if it comes out exactly `out_size` bytes. */
+    int (*inflate)(const unsigned char* in, size_t in_size, unsigned char* out, size_t out_size);
 };
 
 /**
@@ -89,7 +165,9 @@ enum mrs_save_t{
     /**< Creates a MRS file from our MRS handle. */
     MRSS_MRS = 1,
     /**< Creates a folder and put files from our MRS handle in it. */
-    MRSS_FOLDER
+    MRSS_FOLDER,
+    /**< Like `MRSS_MRS`, but saving over the archive files are read from only writes what changed, see `mrs_save`. */
+    MRSS_MRS_INCREMENTAL
 };
 
 
@@ -113,6 +191,54 @@ struct mrs_afile_t{
 };
 typedef mrs_afile_t         *MRSFILE;
 
+/**
+ * Counters of the cache of a MRS handle, see `mrs_get_cache_stats`.
+ */
+typedef struct mrs_cache_stats_t mrs_cache_stats_t;
+struct mrs_cache_stats_t{
+    /**< Reads served from the cache. */
+    unsigned long long hits;
+    /**< Reads that had to read (and inflate) the file. */
+    unsigned long long misses;
+    /**< Files dropped from the cache to fit the budget. */
+    unsigned long long evictions;
+    /**< Files in the cache. */
+    size_t count;
+    /**< Bytes used by the files in the cache. */
+    size_t used;
+    /**< Bytes the files in the cache may use. */
+    size_t budget;
+};
+
+/**
+ * How much of the temporary storage of a MRS handle is used, see `mrs_get_storage_stats`.
+ */
+typedef struct mrs_storage_stats_t mrs_storage_stats_t;
+struct mrs_storage_stats_t{
+    /**< Bytes in the temporary storage. */
+    size_t size;
+    /**< Bytes of it that files still use. */
+    size_t live;
+    /**< Bytes no file uses anymore, what `mrs_compact` gets back. */
+    size_t dead;
+    /**< Files kept in the temporary storage. */
+    size_t files;
+    /**< Times the temporary storage was compacted. */
+    unsigned long long compactions;
+    /**< Bytes compacting got back, all times together. */
+    unsigned long long reclaimed;
+};
+
+/**
+ * Stream over the contents of an archived file, see `mrs_entry_open`.
+ */
+typedef struct mrs_entry_t MRS_ENTRY;
+
+/**
+ * Several MRS handles seen as one, see `mrs_vfs_mount`.
+ */
+typedef struct mrs_vfs_t MRS_VFS;
+
 
 /**
  * \brief Function for progress when compiling or decompiling a MRS archive.
@@ -126,4 +252,23 @@ typedef void (*MRS_PROGRESS_FUNC)(double progress, unsigned index_item,
                                   unsigned total_item, mrs_progress_t action,
                                   const void* param);
 
+/**
+ * \brief Function that receives the files read by `mrs_read_many`.
+ * \param index Index of the file.
+ * \param buf Uncompressed contents of the file, only valid until this function returns.
+ * \param size Size of the file.
+ * \param param Passed as is from `mrs_read_many`.
+ * \return `0` to go on, anything else stops reading the remaining files.
+ */
+typedef int (*MRS_READ_FUNC)(unsigned index, const unsigned char* buf, size_t size, void* param);
+
+/**
+ * \brief Function that receives the files listed by `mrs_list_prefix` and `mrs_list_dir`.
+ * \param index Index of the file.
+ * \param name  Name of the file.
+ * \param param Passed as is from `mrs_list_prefix` or `mrs_list_dir`.
+ * \return `0` to go on, anything else stops listing the remaining files.
+ */
+typedef int (*MRS_LIST_FUNC)(unsigned index, const char* name, void* param);
+
 #endif
\ No newline at end of file
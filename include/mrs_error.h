@@ -24,6 +24,8 @@
 #define MRSE_EMPTY              14 /**< Empty MRS file */
 #define MRSE_NO_MORE_FILES      15 /**< No more files */
 #define MRSE_CANNOT_UNCOMPRESS  16 /**< Error while trying to uncompress file */
-#define MRSE_END                17
+#define MRSE_UNSUPPORTED        17 /**< Operation not supported for this file */
+#define MRSE_OUTDATED           18 /**< Saved data doesn't match the handle anymore */
+#define MRSE_END                19
 
 #endif
\ No newline at end of file
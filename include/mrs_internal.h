@@ -10,8 +10,16 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 #include "dostime.h"
+#include "mrs_defs.h"
 #include "mrs_encryption.h"
+#include "zlib.h"
 
 /*******************************
     TEMPORARY STORAGE METHODS
@@ -21,6 +29,11 @@
 /**< Uses memory for temporary storage */
 #define MRSMT_MEMORY   1
 
+/**< Dead bytes the temporary storage needs at least before it's compacted on its own, see `mrs_set_compact_threshold` */
+#define MRS_COMPACT_MIN  0x100000
+/**< Bytes copied at a time when compacting a temporary file */
+#define MRS_COMPACT_STEP 0x10000
+
 /*******************************
     COMPRESSION METHODS
 *******************************/
@@ -29,6 +42,16 @@
 /**< DEFLATE compression method */
 #define MRSCM_DEFLATE 8
 
+/*******************************
+    FILE FLAGS
+*******************************/
+/**< Local header not read yet, `dh.h.offset` is still where it is (not where the file buffer is) */
+#define MRSFF_LH_PENDING 0x01
+/**< Names live in `_pool` of the handle, they are not freed on their own */
+#define MRSFF_NAME_POOLED 0x02
+/**< `comp` of the file is used instead of the one of the handle */
+#define MRSFF_COMPRESSION 0x04
+
 /*******************************
     SIGNATURES
 *******************************/
@@ -138,6 +161,157 @@ struct mrs_ref_table_t {
     size_t            count;
 };
 
+/*******************************
+    STRING POOL
+*******************************/
+
+/**< Smallest block the pool allocates */
+#define MRS_POOL_BLOCK 0x10000
+
+/**< Block of the string pool, strings are packed right after it */
+struct mrs_pool_block_t {
+    struct mrs_pool_block_t* next;
+    size_t                   size;
+    size_t                   used;
+};
+
+/**< Strings that are only freed along with the handle */
+struct mrs_pool_t {
+    /**< Most recent block first. */
+    struct mrs_pool_block_t* blocks;
+};
+
+/*******************************
+    NAME INDEX
+*******************************/
+
+/**< Slot of the name index */
+struct mrs_index_slot_t {
+    /**< Hash of the name, see `_mrs_name_hash`. */
+    uint32_t hash;
+    /**< One-based index of the file in `_files`, `0` if the slot is empty. */
+    unsigned index;
+};
+
+/**< Hash table (open addressing, linear probing) of the file names of a handle */
+struct mrs_index_t {
+    struct mrs_index_slot_t* slots;
+    /**< Number of slots, a power of two, `0` if there is no index (names are searched one by one then). */
+    size_t                   cap;
+    size_t                   used;
+};
+
+/**< Bits in a block of the name filter, a single cache line is read per lookup */
+#define MRS_BLOOM_BLOCK 512
+/**< Magic number of a name filter file, "MRSB" */
+#define MRS_BLOOM_MAGIC 0x4253524d
+#define MRS_BLOOM_VERSION 1
+
+/**< Blocked Bloom filter of the names of a handle, see `mrs_set_name_filter` */
+struct mrs_bloom_t {
+    /**< `nblocks` blocks of `MRS_BLOOM_BLOCK` bits, `NULL` if there is no filter. */
+    uint64_t* bits;
+    size_t    nblocks;
+    /**< Bits set per name. */
+    unsigned  k;
+    unsigned  bits_per_name;
+    /**< How many names it was made for, it's made again bigger past that. */
+    size_t    cap;
+    size_t    names;
+    /**< Sum of the (mixed) hashes of all the names, kept even without a filter to tell if a saved one is still good. */
+    uint64_t  sum;
+};
+
+#pragma pack(4)
+/**< Header of a name filter file, followed by the blocks */
+struct mrs_bloom_hdr_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t k;
+    uint32_t bits_per_name;
+    /**< Number of names and `sum` of the handle the filter was saved from. */
+    uint64_t names;
+    uint64_t sum;
+    uint64_t nblocks;
+};
+#pragma pack()
+
+/**< Highest N of a " (N)" name that is kept track of */
+#define MRS_STEM_MAX_NUM 0x10000
+
+/**< Names ending in " (N)" that are the same without it, see `_mrs_is_duplicate` */
+struct mrs_stem_t {
+    uint32_t  hash;
+    /**< The name without " (N)", as it is compared (see `_mrs_name_eq`), `NULL` if the slot is empty. */
+    char*     key;
+    /**< How many files there are with each N. */
+    unsigned* counts;
+    size_t    ncounts;
+    /**< Lowest N (from `2` on) that no file has. */
+    unsigned  free;
+};
+
+/**< Hash table (open addressing, linear probing) of stems, they are never taken out */
+struct mrs_stems_t {
+    struct mrs_stem_t* slots;
+    /**< Number of slots, a power of two. */
+    size_t             cap;
+    size_t             used;
+};
+
+/**< Indices of the files, in order of name (as compared by `_mrs_name_eq`), see `mrs_list_prefix` */
+struct mrs_names_t {
+    unsigned* order;
+    /**< How many indices there are, the ones from `sorted` on were added since it was last sorted. */
+    size_t    count;
+    size_t    sorted;
+    size_t    cap;
+    /**< `1` if `order` couldn't keep up (out of memory) and has to be made again from all the files. */
+    int       stale;
+};
+
+/*******************************
+    GLOB
+*******************************/
+
+/**< Kinds of tokens of a pattern, see `mrs_find_glob` */
+enum mrs_glob_tok_type_t {
+    /**< One character. */
+    MRSGT_CHAR,
+    /**< `?`, any character but `/`. */
+    MRSGT_ANY,
+    /**< `[...]`, any character of a set. */
+    MRSGT_SET,
+    /**< `*`, any characters but `/`. */
+    MRSGT_STAR,
+    /**< `**`, any characters. */
+    MRSGT_DSTAR,
+    /**< `**` followed by `/`, any number of whole folders (none too). */
+    MRSGT_DIRS
+};
+
+struct mrs_glob_tok_t {
+    unsigned char type;
+    /**< The character (as compared, see `_mrs_name_eq`), for `MRSGT_CHAR`. */
+    unsigned char c;
+    /**< One bit per character (as compared) that matches, for `MRSGT_SET`. */
+    unsigned char set[32];
+};
+
+/**< A pattern of `mrs_find_glob`, turned into tokens */
+struct mrs_glob_t {
+    struct mrs_glob_tok_t* toks;
+    size_t                 count;
+    /**< How many tokens at the start and at the end are `MRSGT_CHAR`, `suffix` is `0` if they all are. */
+    size_t                 prefix;
+    size_t                 suffix;
+    /**< The first `prefix` characters. */
+    char*                  lit;
+    /**< Where the names starting with `lit` are in the name order. */
+    size_t                 lo;
+    size_t                 hi;
+};
+
 /*******************************
     FILES
 *******************************/
@@ -161,11 +335,310 @@ struct mrs_afile_internal_t{
 struct mrs_file_t{
     struct mrs_central_dir_hdr_ex_t dh;
     struct mrs_local_hdr_ex_t       lh;
+    /**< Where the file buffer is, `0` = temporary storage, otherwise one-based index of `_srcs`. */
+    unsigned                        src;
+    /**< Inflate checkpoints, built by `mrs_read_range`, `NULL` until then. */
+    struct mrs_zindex_t*            zidx;
+    /**< `MRSFF_*` values, changed by readers too, see `_mrs_file_flags`. */
+    volatile long                   flags;
+    /**< How the file is compressed when written to, if `MRSFF_COMPRESSION` is set. */
+    struct mrs_compression_t        comp;
+};
+
+/*******************************
+    INFLATE CHECKPOINTS
+*******************************/
+
+/**< Uncompressed bytes between two checkpoints */
+#define MRS_ZINDEX_SPAN   0x100000
+/**< Size of the deflate window, saved with every checkpoint */
+#define MRS_ZINDEX_WINDOW 0x8000
+
+/**< Point of a DEFLATE file where inflating can start from */
+struct mrs_zpoint_t{
+    /**< Offset in the uncompressed file. */
+    size_t        out;
+    /**< Offset in the compressed buffer of the first full byte. */
+    size_t        in;
+    /**< Bits of the byte before `in` that still belong to this point, `0` to `7`. */
+    int           bits;
+    /**< Last `MRS_ZINDEX_WINDOW` uncompressed bytes before `out`. */
+    unsigned char window[MRS_ZINDEX_WINDOW];
+};
+
+/**< Checkpoints of a file, sorted by offset */
+struct mrs_zindex_t{
+    struct mrs_zpoint_t* points;
+    size_t               count;
 };
 
 struct mrs_files_t{
     struct mrs_file_t* files;
     size_t count;
+    /**< How many `files` has room for. */
+    size_t cap;
+};
+
+/*******************************
+    SOURCES
+*******************************/
+
+/**< A MRS archive that files of a MRS handle are still read from */
+struct mrs_source_t{
+    /**< Full path of the archive, `NULL` if it was given as a memory buffer. */
+    char*               name;
+    /**< The archive itself, `NULL` if it is mapped. */
+    FILE*               fp;
+    /**< Read-only view of the archive, used instead of `fp` with `MRSF_MMAP` (or the buffer given with `MRSA_MRS_MEMORY`). */
+    const unsigned char* map;
+    /**< `1` if `map` belongs to the caller, it isn't unmapped then. */
+    int                 borrowed;
+    /**< Size of the archive. */
+    size_t              size;
+    /**< Decryption routine of the file buffers in the archive. */
+    MRS_ENCRYPTION_FUNC dec;
+    /**< Decryption routine of the local headers, for the ones read later (see `MRSF_TRUST_CDIR`). */
+    MRS_ENCRYPTION_FUNC lhdec;
+    /**< How many files (plus whoever opened it) are still using it, `0` if this slot is not in use. */
+    unsigned            ref;
+};
+
+/**< List of sources */
+struct mrs_source_list_t{
+    struct mrs_source_t* srcs;
+    size_t               count;
+};
+
+/*******************************
+    ENTRY STREAMS
+*******************************/
+
+/**< How much of the compressed buffer an entry stream reads at once */
+#define MRS_ENTRY_WINDOW 0x10000
+
+/**< Stream over the contents of a file, see `mrs_entry_open` */
+struct mrs_entry_t{
+    const struct mrs_t* mrs;
+    /**< Copy of the file as it was when the stream was opened. */
+    struct mrs_file_t  f;
+    /**< Where the next read from the compressed buffer starts. */
+    size_t             cpos;
+    /**< How much was given to the caller so far. */
+    size_t             upos;
+    /**< Compressed data being inflated, `MRS_ENTRY_WINDOW` bytes, `NULL` if not needed. */
+    unsigned char*     win;
+    z_stream           z;
+    /**< `1` if `z` was initialized. */
+    int                zinit;
+    /**< `1` once the whole file was given to the caller. */
+    int                done;
+};
+
+/*******************************
+    VFS
+*******************************/
+
+/**< A handle mounted in a VFS, see `mrs_vfs_mount` */
+struct mrs_vfs_mount_t {
+    /**< `NULL` if the slot is free. */
+    const struct mrs_t* mrs;
+    /**< Same as `mrs` if the VFS opened it (and frees it), `NULL` otherwise. */
+    struct mrs_t*       owned;
+    int                 priority;
+    /**< Order of mounting, the last one mounted wins among the same `priority`. */
+    unsigned            seq;
+    /**< What names of `mrs` are prefixed with in the VFS, ending in `/` (or empty). */
+    char*               point;
+    size_t              point_len;
+    /**< Hash of `point`, names of `mrs` are hashed on from it. */
+    uint32_t            point_hash;
+    /**< How many slots of the table this mount has. */
+    size_t              count;
+};
+
+/**< Name of the VFS in the table, any number of mounts may have the same one */
+struct mrs_vfs_slot_t {
+    uint32_t hash;
+    /**< One-based index of the mount, `0` if the slot is empty. */
+    unsigned mount;
+    /**< Index of the file in the mounted handle. */
+    unsigned index;
+};
+
+struct mrs_vfs_t {
+    struct mrs_vfs_mount_t* mounts;
+    size_t                  nmounts;
+    unsigned                seq;
+    /**< Hash table (open addressing, linear probing) of all the files of all the mounts. */
+    struct mrs_vfs_slot_t*  slots;
+    /**< Number of slots, a power of two. */
+    size_t                  cap;
+    size_t                  used;
+};
+
+/*******************************
+    BATCH READS
+*******************************/
+
+/**< Largest hole between two file buffers that are still read together */
+#define MRS_BATCH_GAP 0x1000
+/**< Largest read that file buffers are merged into (a single bigger file is still read whole) */
+#define MRS_BATCH_MAX 0x400000
+
+/**< File to be read by `mrs_read_many` */
+struct mrs_batch_item_t{
+    unsigned index;
+    unsigned src;
+    size_t   offset;
+    size_t   csize;
+};
+
+/*******************************
+    CACHE
+*******************************/
+
+/**< Buckets of the cache to begin with, doubled whenever there are as many items */
+#define MRS_CACHE_BUCKETS 64
+
+/**< Uncompressed contents of a file, kept by the cache */
+struct mrs_cache_item_t{
+    /**< Where the file buffer is, the key of the item, together with `offset` and `csize`. */
+    unsigned       src;
+    uint32_t       offset;
+    uint32_t       csize;
+    unsigned char* buf;
+    size_t         size;
+    /**< `1` if the item must not be evicted, pinned items are left out of the LRU list. */
+    int            pinned;
+    /**< Next item of the same bucket. */
+    struct mrs_cache_item_t* next;
+    /**< Items used right before (`lru_prev`) and right after (`lru_next`) this one. */
+    struct mrs_cache_item_t* lru_prev;
+    struct mrs_cache_item_t* lru_next;
+};
+
+/**< Cache of uncompressed files, see `mrs_set_cache` */
+struct mrs_cache_t{
+    /**< Items by key, `nbuckets` is a power of two. */
+    struct mrs_cache_item_t** buckets;
+    size_t                   nbuckets;
+    size_t                   count;
+    /**< Items that may be evicted, from the most recently used (`lru_head`) to the least (`lru_tail`), the first to go. */
+    struct mrs_cache_item_t* lru_head;
+    struct mrs_cache_item_t* lru_tail;
+    /**< Bytes the items may use, and bytes they use. */
+    size_t                   budget;
+    size_t                   used;
+    unsigned long long       stats_hits;
+    unsigned long long       stats_misses;
+    unsigned long long       stats_evictions;
+};
+
+/*******************************
+    COMPRESSIBILITY PREDICTION
+*******************************/
+
+/**< Files smaller than this are deflated without guessing first */
+#define MRS_PREDICT_MIN     512
+/**< Bytes sampled to guess if a file is random, in `MRS_PREDICT_SAMPLES` pieces spread over it */
+#define MRS_PREDICT_SAMPLE  0x10000
+#define MRS_PREDICT_SAMPLES 16
+/**< Bits per byte from which the sample is taken as random (`8` is as random as it gets) */
+#define MRS_PREDICT_ENTROPY 7.9
+/**< Deflating gives up if the first `MRS_PREDICT_PROBE` bytes don't get down to `MRS_PREDICT_RATIO`% or less */
+#define MRS_PREDICT_PROBE   0x80000
+#define MRS_PREDICT_RATIO   90
+
+/**< How a kind of file that's compressed already starts */
+struct mrs_magic_t{
+    size_t      offset;
+    const char* bytes;
+    size_t      len;
+};
+
+/*******************************
+    COMPRESSION CACHE
+*******************************/
+
+/**< Magic number of a compression cache entry, "MRCC" */
+#define MRS_CCACHE_MAGIC   0x4343524d
+#define MRS_CCACHE_VERSION 2
+
+#pragma pack(4)
+/**< Header of a compression cache entry, followed by `csize` bytes of compressed buffer */
+struct mrs_ccache_hdr_t {
+    uint32_t magic;
+    uint32_t version;
+    /**< Size, CRC32 and hash of the buffer it was compressed from, checked again when read. */
+    uint64_t size;
+    uint64_t hash;
+    uint32_t crc32;
+    /**< `MRSCM_DEFLATE`, or `MRSCM_STORE` if the buffer is better stored as is (`csize` is `0` then). */
+    uint32_t compression;
+    uint64_t csize;
+    /**< CRC32 of the compressed buffer, so an entry that got cut short or changed on disk is a miss. */
+    uint32_t ccrc32;
+};
+#pragma pack()
+
+/*******************************
+    PARALLEL ADD
+*******************************/
+
+/**< Storage of what each thread keeps to (de)compress files */
+#ifndef MRS_THREAD_LOCAL
+#ifdef _MSC_VER
+#define MRS_THREAD_LOCAL __declspec(thread)
+#else
+#define MRS_THREAD_LOCAL __thread
+#endif
+#endif
+
+/**< A file buffer ready to be written to the temporary storage, see `_mrs_pack`. */
+struct mrs_packed_t{
+    /**< Compressed buffer (or the buffer as is, if stored). */
+    unsigned char* buf;
+    size_t         csize;
+    /**< Size and CRC32 of the uncompressed buffer. */
+    size_t         size;
+    uint32_t       crc32;
+    uint16_t       compression;
+};
+
+/**< A file to be read and packed by a worker, see `_mrs_add_paths`. */
+struct mrs_ingest_job_t{
+    const char*         path;
+    /**< Name given to the file, as it was listed (before `_mrs_add_check`). */
+    const char*         name;
+    time_t              mtime;
+    struct mrs_packed_t packed;
+    /**< `MRSE_OK`, or why the file couldn't be read. */
+    int                 error;
+    /**< `1` once the worker is done with it. */
+    int                 done;
+};
+
+/**< Files being packed by workers, and given back to the calling thread in the order they were listed. */
+struct mrs_ingest_t{
+    struct mrs_ingest_job_t* jobs;
+    size_t                   count;
+    /**< Next job a worker takes. */
+    size_t                   next;
+    /**< Jobs before this one were taken back by the calling thread. */
+    size_t                   committed;
+    /**< How many jobs the workers may be ahead of `committed`, so they don't pack everything into memory at once. */
+    size_t                   window;
+    /**< `1` if the workers must stop taking jobs. */
+    int                      stop;
+    /**< Handle the files are packed for, only how it compresses files is read from it. */
+    const struct mrs_t*      mrs;
+#ifdef _WIN32
+    CRITICAL_SECTION         lock;
+    CONDITION_VARIABLE       cond;
+#else
+    pthread_mutex_t          lock;
+    pthread_cond_t           cond;
+#endif
 };
 
 /*******************************
@@ -190,6 +663,18 @@ struct mrs_t{
     struct mrs_ref_table_t _reftable;
     /**< List of files, count is given in `_hdr.dir_count`. */
     struct mrs_file_t*     _files;
+    /**< How many `_files` has room for. */
+    size_t                 _files_cap;
+    /**< Names of the files read from archives. */
+    struct mrs_pool_t      _pool;
+    /**< Index of `_files` by name, see `mrs_find_file`. */
+    struct mrs_index_t     _index;
+    /**< Which " (N)" names are taken, see `_mrs_is_duplicate`. */
+    struct mrs_stems_t     _stems;
+    /**< Files in order of name, see `mrs_list_prefix`. */
+    struct mrs_names_t     _names;
+    /**< Filter that rules out most names that aren't in `_files`, see `mrs_set_name_filter`. */
+    struct mrs_bloom_t     _bloom;
     
     /**< Temporary storage. */
     union{
@@ -200,8 +685,39 @@ struct mrs_t{
     };
     /**< Temporary storage type, `0` = Temporary file, `1` = Memory */
     int                _mtype;
-    /**< Size of `_mbuf`. */
+    /**< Size of the temporary storage (`_mbuf` or `_fbuf`). */
     size_t             _mbuf_size;
+    /**< How much `_mbuf` has room for. */
+    size_t             _mbuf_cap;
+    /**< Bytes of the temporary storage left behind by files written, replaced or removed since it was last compacted. */
+    size_t             _mbuf_dead;
+    /**< Options set with `mrs_set_flags`. */
+    int                _flags;
+    /**< Threads that pack files for folder adds, see `mrs_set_threads`, `0` or `1` packs them on the calling thread. */
+    unsigned           _threads;
+    /**< How added and written files are compressed, see `mrs_set_compression`. */
+    struct mrs_compression_t _comp;
+    /**< DEFLATE backend, see `mrs_set_codec`, `NULL` is zlib. */
+    const struct mrs_codec_t* _codec;
+    /**< Directory of the compression cache, see `mrs_set_compression_cache`, `NULL` if not set. */
+    char*                     _ccache;
+    /**< Most dead space (in percent) `MRSS_MRS_INCREMENTAL` leaves, see `mrs_set_incremental_threshold`. */
+    unsigned                  _inc_threshold;
+    /**< Dead space (in percent) of the temporary storage past which it's compacted, see `mrs_set_compact_threshold`. */
+    unsigned                  _compact_threshold;
+    /**< Times the temporary storage was compacted, and bytes it got back. */
+    unsigned long long        _compactions;
+    unsigned long long        _reclaimed;
+    /**< Archives opened with `MRSF_LAZY`, which some files are still read from. */
+    struct mrs_source_list_t _srcs;
+    /**< Cache of uncompressed files, `NULL` if not enabled with `mrs_set_cache`. */
+    struct mrs_cache_t*      _cache;
+    /**< Guards what reading changes, see `_mrs_lock`. */
+#ifdef _WIN32
+    CRITICAL_SECTION         _lock;
+#else
+    pthread_mutex_t          _lock;
+#endif
 };
 
 /*******************************
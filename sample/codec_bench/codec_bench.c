@@ -0,0 +1,132 @@
+/***************************************************************
+    codec_bench
+    Compares the DEFLATE backends of libmrs on a folder.
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "mrs.h"
+
+#define PROGRAM_NAME "codec_bench.exe"
+#define OUTPUT_NAME  "codec_bench.mrs"
+
+struct codec_bench_sum_t{
+    size_t   bytes;
+    uint32_t hash;
+};
+
+static double codec_bench_now(){
+    struct timespec ts;
+
+    timespec_get(&ts, TIME_UTC);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Hashes everything read (FNV-1a), every backend has to get the same bytes back */
+static int codec_bench_sink(unsigned index, const unsigned char* buf, size_t size, void* param){
+    struct codec_bench_sum_t* sum = (struct codec_bench_sum_t*)param;
+    size_t i;
+
+    for(i=0; i<size; i++)
+        sum->hash = (sum->hash ^ buf[i]) * 16777619u;
+    sum->bytes += size;
+
+    return 0;
+}
+
+/* Packs `folder` with `codec`, then reads the saved archive back with `reader` */
+static int codec_bench_run(const char* folder, const mrs_codec_t* codec, const mrs_codec_t* reader, int level, unsigned threads){
+    struct codec_bench_sum_t sum = {0, 2166136261u};
+    MRS*      mrs;
+    unsigned* indices;
+    size_t    count, csize, total = 0, i;
+    double    t0, t1, t2, t3;
+    int       e;
+
+    mrs = mrs_init();
+    mrs_set_codec(mrs, codec);
+    mrs_set_compression(mrs, level, MRSCS_DEFAULT);
+    mrs_set_threads(mrs, threads);
+
+    t0 = codec_bench_now();
+    e = mrs_add(mrs, MRSA_FOLDER, MRSDB_KEEP_BOTH, NULL, folder, NULL);
+    t1 = codec_bench_now();
+    if(e == MRSE_OK)
+        e = mrs_save(mrs, MRSS_MRS, OUTPUT_NAME, NULL);
+    count = mrs_get_file_count(mrs);
+    for(i=0; i<count; i++){
+        if(mrs_get_file_info(mrs, i, MRSFI_CSIZE, &csize, sizeof(size_t), NULL) == MRSE_OK)
+            total += csize;
+    }
+    mrs_free(mrs);
+    if(e != MRSE_OK){
+        fprintf(stderr, "Can't pack \"%s\": %s\n", folder, mrs_get_error_str(e));
+        return e;
+    }
+
+    mrs = mrs_init();
+    mrs_set_codec(mrs, reader);
+    e = mrs_add(mrs, MRSA_MRS, MRSDB_KEEP_BOTH, NULL, OUTPUT_NAME, NULL);
+    count = mrs_get_file_count(mrs);
+    indices = (unsigned*)malloc((count ? count : 1) * sizeof(unsigned));
+    for(i=0; i<count; i++)
+        indices[i] = i;
+    t2 = codec_bench_now();
+    if(e == MRSE_OK && indices)
+        e = mrs_read_many(mrs, indices, count, codec_bench_sink, &sum);
+    t3 = codec_bench_now();
+    free(indices);
+    mrs_free(mrs);
+    if(e != MRSE_OK){
+        fprintf(stderr, "Can't read \"%s\" back: %s\n", OUTPUT_NAME, mrs_get_error_str(e));
+        return e;
+    }
+
+    printf("%-10s %-10s %5d %7u %10.3f %10.3f %12u %12u %08X\n", codec->name, reader->name, level, threads,
+           t1 - t0, t3 - t2, (unsigned)sum.bytes, (unsigned)total, sum.hash);
+
+    return 0;
+}
+
+int main(int argc, char** argv){
+    const mrs_codec_t* codecs[2];
+    const int levels[] = {MRSCL_FASTEST, 6, MRSCL_BEST};
+    unsigned threads = 1, ncodecs = 0, i, j, k;
+
+    if(argc < 2){
+        printf("Usage: %s <folder> [threads]\n", PROGRAM_NAME);
+        return 1;
+    }
+    if(argc > 2)
+        threads = (unsigned)atoi(argv[2]);
+
+    codecs[ncodecs++] = mrs_codec_zlib();
+    if(mrs_codec_libdeflate())
+        codecs[ncodecs++] = mrs_codec_libdeflate();
+    else
+        printf("libmrs was built without LIBMRS_LIBDEFLATE, only zlib is compared\n\n");
+
+    printf("%-10s %-10s %5s %7s %10s %10s %12s %12s %s\n", "deflate", "inflate", "level", "threads",
+           "pack (s)", "read (s)", "size", "compressed", "hash");
+
+    // Every backend packs, and reads back what every other one packed
+    for(i=0; i<ncodecs; i++){
+        for(k=0; k<sizeof(levels) / sizeof(levels[0]); k++){
+            for(j=0; j<ncodecs; j++){
+                if(codec_bench_run(argv[1], codecs[i], codecs[j], levels[k], threads))
+                    return 2;
+            }
+        }
+    }
+
+    remove(OUTPUT_NAME);
+    mrs_thread_cleanup();
+
+    return 0;
+}
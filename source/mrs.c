@@ -59,7 +59,7 @@ extern unsigned char* _mrs_ref_table_append(struct mrs_ref_table_t* r,
                   /// FROM mrs_util.c
            extern int _mrs_is_initialized(const MRS* mrs);
                   /// FROM mrs_util.c
-           extern int _mrs_temp_read(MRS* mrs,
+           extern int _mrs_temp_read(const MRS* mrs,
                                      unsigned char* buf,
                                      off_t offset,
                                      size_t size);
@@ -67,19 +67,106 @@ extern unsigned char* _mrs_ref_table_append(struct mrs_ref_table_t* r,
            extern int _mrs_temp_write(MRS* mrs,
                                       unsigned char* buf,
                                       size_t size);
+                  /// FROM mrs_util.c
+           extern int _mrs_temp_set_type(MRS* mrs,
+                                         int type);
+                  /// FROM mrs_util.c
+           extern int _mrs_file_read(const MRS* mrs,
+                                     struct mrs_file_t* f,
+                                     unsigned char* buf);
+                  /// FROM mrs_util.c
+extern const unsigned char* _mrs_file_ptr(const MRS* mrs,
+                                          struct mrs_file_t* f);
+                  /// FROM mrs_source.c
+           extern int _mrs_file_resolve(const MRS* mrs,
+                                        struct mrs_file_t* f);
+                  /// FROM mrs_util.c
+          extern void _mrs_file_clear_flags(struct mrs_file_t* f,
+                                            long flags);
+                  /// FROM mrs_util.c
+          extern void _mrs_lock_init(MRS* mrs);
+                  /// FROM mrs_util.c
+          extern void _mrs_lock_free(MRS* mrs);
+                  /// FROM mrs_source.c
+          extern void _mrs_source_list_init(struct mrs_source_list_t* l);
+                  /// FROM mrs_source.c
+          extern void _mrs_source_release(MRS* mrs,
+                                          unsigned src);
+                  /// FROM mrs_source.c
+          extern void _mrs_source_free_all(struct mrs_source_list_t* l);
+                  /// FROM mrs_cache.c
+           extern int _mrs_cache_get(const MRS* mrs,
+                                     const struct mrs_file_t* f,
+                                     unsigned char* buf);
+                  /// FROM mrs_cache.c
+           extern int _mrs_cache_put(const MRS* mrs,
+                                     const struct mrs_file_t* f,
+                                     const unsigned char* buf,
+                                     size_t size,
+                                     int pinned);
+                  /// FROM mrs_cache.c
+          extern void _mrs_cache_drop(MRS* mrs,
+                                      const struct mrs_file_t* f);
+                  /// FROM mrs_cache.c
+          extern void _mrs_cache_free(MRS* mrs);
+                  /// FROM mrs_util.c
+          extern void _mrs_temp_release(MRS* mrs,
+                                        const struct mrs_file_t* f);
+                  /// FROM mrs_compact.c
+          extern void _mrs_compact_auto(MRS* mrs);
                   /// FROM mrs_file.c
           extern void _mrs_file_free(struct mrs_file_t* f);
+                  /// FROM mrs_file.c
+          extern void _mrs_file_drop_index(struct mrs_file_t* f);
+                  /// FROM mrs_pool.c
+          extern void _mrs_pool_init(struct mrs_pool_t* p);
+                  /// FROM mrs_index.c
+           extern int _mrs_index_find(const MRS* mrs,
+                                      const char* s,
+                                      unsigned* index);
+                  /// FROM mrs_index.c
+          extern void _mrs_index_add(MRS* mrs,
+                                     unsigned i);
+                  /// FROM mrs_index.c
+          extern void _mrs_index_remove(MRS* mrs,
+                                        unsigned i);
+                  /// FROM mrs_index.c
+          extern void _mrs_index_forget(MRS* mrs,
+                                        unsigned i);
+                  /// FROM mrs_index.c
+          extern void _mrs_index_free(MRS* mrs);
+                  /// FROM mrs_index.c
+          extern void _mrs_stems_free(MRS* mrs);
+                  /// FROM mrs_list.c
+          extern void _mrs_names_free(MRS* mrs);
+                  /// FROM mrs_bloom.c
+          extern void _mrs_bloom_free(MRS* mrs);
+                  /// FROM mrs_pool.c
+          extern void _mrs_pool_free(struct mrs_pool_t* p);
+                  /// FROM mrs_compress.c
+           extern int _mrs_pack(const MRS* mrs,
+                                const struct mrs_compression_t* c,
+                                const void* buffer,
+                                size_t buffer_size,
+                                const char* name,
+                                struct mrs_packed_t* p);
+                  /// FROM mrs_compress.c
+           extern int _mrs_inflate(const MRS* mrs,
+                                   const unsigned char* in,
+                                   size_t in_size,
+                                   unsigned char* out,
+                                   size_t out_size);
+                  /// FROM mrs_compress.c
+          extern void _mrs_codec_thread_cleanup();
+                  /// FROM mrs_compress.c
+extern const struct mrs_compression_t* _mrs_file_compression(const MRS* mrs,
+                                                             const struct mrs_file_t* f);
+                  /// FROM mrs_compress.c
+           extern int _mrs_set_file_compression(MRS* mrs,
+                                                unsigned index,
+                                                const struct mrs_compression_t* c);
                   /// FROM utils.c
-           extern int _compress_file(unsigned char* inbuf,
-                                     size_t total_in,
-                                     unsigned char** outbuf,
-                                     size_t* total_out);
-                  /// FROM mrs_util.c
-           extern int _uncompress_file(unsigned char* inbuf,
-                                       size_t total_in,
-                                       unsigned char* outbuf,
-                                       size_t uncompressed_size,
-                                       size_t* out_size);
+          extern void _mrs_thread_cleanup();
                   /// FROM mrs_util.c
            extern int _is_valid_input_filename(const char* s);
                   /// FROM mrs_util.c
@@ -145,14 +232,22 @@ extern unsigned char* _mrs_ref_table_append(struct mrs_ref_table_t* r,
                                    void* reserved,
                                    enum mrs_dupe_behavior_t on_dupe);
                   /// FROM mrs_add.c
+           extern int _mrs_add_mrs_memory(MRS* mrs,
+                                          const void* buffer,
+                                          size_t size,
+                                          char* base_name,
+                                          void* reserved,
+                                          enum mrs_dupe_behavior_t on_dupe);
+                  /// FROM mrs_add.c
            extern int _mrs_add_mrs2(MRS* mrs,
                                     MRS* in,
                                     char* base_name,
                                     void* reserved,
                                     enum mrs_dupe_behavior_t on_dupe);
                   /// FROM mrs_save.c
-           extern int _mrs_save_mrs_fname(const MRS* mrs,
+           extern int _mrs_save_mrs_fname(MRS* mrs,
                                           const char* output,
+                                          int incremental,
                                           MRS_PROGRESS_FUNC pcallback);
                   /// FROM mrs_save.c
            extern int _mrs_save_mrs(const MRS* mrs,
@@ -183,6 +278,12 @@ MRS* mrs_init(){
     mrs->_ptr = mrs;    
     mrs->_fbuf = tmpfile();
     _mrs_ref_table_init(&mrs->_reftable);
+    _mrs_pool_init(&mrs->_pool);
+    _mrs_source_list_init(&mrs->_srcs);
+    _mrs_lock_init(mrs);
+    mrs->_comp.level    = MRSCL_BEST;
+    mrs->_comp.strategy = MRSCS_DEFAULT;
+    mrs->_inc_threshold = 25;
     if(!mrs->_fbuf){
         dbgprintf("Could not open temp file, let's use memory then");
         mrs->_mtype = MRSMT_MEMORY;
@@ -250,9 +351,29 @@ int mrs_set_encryption(MRS* mrs, int where, MRS_ENCRYPTION_FUNC f){
     return MRSE_OK;
 }
 
+int mrs_set_flags(MRS* mrs, int flags){
+    int r;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if((flags ^ mrs->_flags) & MRSF_MEMORY_STORAGE){
+        r = _mrs_temp_set_type(mrs, (flags & MRSF_MEMORY_STORAGE) ? MRSMT_MEMORY : MRSMT_TEMPFILE);
+        // Without a temporary file, memory is all there is (same as in mrs_init)
+        if(r != MRSE_OK && (flags & MRSF_MEMORY_STORAGE))
+            return r;
+    }
+
+    dbgprintf("Setting flags to %#x", flags);
+    mrs->_flags = flags;
+
+    return MRSE_OK;
+}
+
 int mrs_add(MRS* mrs, enum mrs_add_t what, enum mrs_dupe_behavior_t on_dupe, void* reserved, ...){
     va_list a;
     void    *par1, *par2, *par3, *par4;
+    int     e;
 
     dbgprintf("Let's add something!");
 
@@ -266,33 +387,38 @@ int mrs_add(MRS* mrs, enum mrs_add_t what, enum mrs_dupe_behavior_t on_dupe, voi
         dbgprintf("From file");
         par1 = va_arg(a, const char*);
         par2 = va_arg(a, char*);
-        return _mrs_add_file(mrs, (const char*)par1, (char*)par2, reserved, on_dupe, 1, NULL, NULL, NULL);
+        e = _mrs_add_file(mrs, (const char*)par1, (char*)par2, reserved, on_dupe, 1, NULL, NULL, NULL);
+        break;
     case MRSA_FOLDER:
         dbgprintf("From directory");
         par1 = va_arg(a, const char*);
         par2 = va_arg(a, char*);
-        return _mrs_add_folder(mrs, (const char*)par1, (char*)par2, reserved, on_dupe);
+        e = _mrs_add_folder(mrs, (const char*)par1, (char*)par2, reserved, on_dupe);
+        break;
     case MRSA_MRS:
         dbgprintf("From MRS archive");
         par1 = va_arg(a, const char*);
         par2 = va_arg(a, char*);
-        return _mrs_add_mrs(mrs, (const char*)par1, (char*)par2, reserved, on_dupe);
+        e = _mrs_add_mrs(mrs, (const char*)par1, (char*)par2, reserved, on_dupe);
+        break;
     case MRSA_MRS2:
         dbgprintf("From MRS handle");
         par1 = va_arg(a, MRS*);
         par2 = va_arg(a, char*);
-        return _mrs_add_mrs2(mrs, (MRS*)par1, (char*)par2, reserved, on_dupe);
+        e = _mrs_add_mrs2(mrs, (MRS*)par1, (char*)par2, reserved, on_dupe);
         break;
     case MRSA_FILEPTR:
         dbgprintf("From FILE pointer");
         par1 = va_arg(a, FILE*);
         par2 = va_arg(a, char*);
-        return _mrs_add_fileptr(mrs, (FILE*)par1, (char*)par2, reserved, on_dupe, 1, 1, 1, NULL, NULL, NULL);
+        e = _mrs_add_fileptr(mrs, (FILE*)par1, (char*)par2, reserved, on_dupe, 1, 1, 1, NULL, NULL, NULL);
+        break;
     case MRSA_FILEDES:
         dbgprintf("From file descriptor");
         par1 = va_arg(a, int);
         par2 = va_arg(a, char*);
-        return _mrs_add_filedes(mrs, (int)par1, (char*)par2, reserved, on_dupe, 1, 1, 1, NULL, NULL, NULL);
+        e = _mrs_add_filedes(mrs, (int)par1, (char*)par2, reserved, on_dupe, 1, 1, 1, NULL, NULL, NULL);
+        break;
     case MRSA_MEMORY:
         dbgprintf("From memory");
         par1 = va_arg(a, const void*);
@@ -300,12 +426,26 @@ int mrs_add(MRS* mrs, enum mrs_add_t what, enum mrs_dupe_behavior_t on_dupe, voi
         par3 = va_arg(a, const char*);
         par4 = time(NULL);
         //return _mrs_add_memory(mrs, (const void*)par1, (size_t)par2, (const char*)par3, (time_t)&par4, reserved, on_dupe, 1, 1);
-        return _mrs_add_memory(mrs, (const void*)par1, (size_t)par2, (const char*)par3, (const time_t*)&par4, reserved, on_dupe, 1, 1, 1, NULL, NULL, NULL);
+        e = _mrs_add_memory(mrs, (const void*)par1, (size_t)par2, (const char*)par3, (const time_t*)&par4, reserved, on_dupe, 1, 1, 1, NULL, NULL, NULL);
+        break;
+    case MRSA_MRS_MEMORY:
+        dbgprintf("From MRS archive in memory");
+        par1 = va_arg(a, const void*);
+        par2 = va_arg(a, size_t);
+        par3 = va_arg(a, char*);
+        e = _mrs_add_mrs_memory(mrs, (const void*)par1, (size_t)par2, (char*)par3, reserved, on_dupe);
+        break;
     default:
-        return MRSE_INVALID_PARAM;
+        e = MRSE_INVALID_PARAM;
+        break;
     }
+    va_end(a);
 
-    return MRSE_OK;
+    // Files replaced by the new ones leave their buffers behind
+    if(e == MRSE_OK)
+        _mrs_compact_auto(mrs);
+
+    return e;
 }
 
 /*******************************
@@ -338,6 +478,7 @@ int mrs_add(MRS* mrs, enum mrs_add_t what, void* param1, void* param2, enum mrs_
 
 int mrs_read(const MRS* mrs, unsigned index, unsigned char* buf, size_t buf_size, size_t* out_size){
     unsigned char* temp;
+    const unsigned char* ptr;
     struct mrs_file_t* f;
 	int r = MRSE_OK;
 
@@ -350,6 +491,9 @@ int mrs_read(const MRS* mrs, unsigned index, unsigned char* buf, size_t buf_size
     }
 
     f = &mrs->_files[index];
+
+    if(!_mrs_file_resolve(mrs, f))
+        return MRSE_INVALID_ENCRYPTION;
     
     dbgprintf("Stored at %08x", f->dh.h.offset);
     
@@ -358,23 +502,88 @@ int mrs_read(const MRS* mrs, unsigned index, unsigned char* buf, size_t buf_size
             *out_size = f->dh.h.uncompressed_size;
         if(buf_size < f->dh.h.uncompressed_size || !buf)
             return MRSE_INSUFFICIENT_MEM;
-        _mrs_temp_read(mrs, buf, f->dh.h.offset, f->dh.h.uncompressed_size);
+        // What is read is `compressed_size` bytes, it has to fit
+        if(f->dh.h.compressed_size != f->dh.h.uncompressed_size)
+            return MRSE_INVALID_MRS;
+        if(_mrs_cache_get(mrs, f, buf))
+            return MRSE_OK;
+        if(!_mrs_file_read(mrs, f, buf))
+            return MRSE_CANNOT_OPEN;
     }else{
         if(out_size)
             *out_size = f->dh.h.uncompressed_size;
         if(buf_size < f->dh.h.uncompressed_size || !buf)
             return MRSE_INSUFFICIENT_MEM;
-        temp = (unsigned char*)malloc(mrs->_files[index].dh.h.compressed_size);
-        _mrs_temp_read(mrs, temp, f->dh.h.offset, f->dh.h.compressed_size);
-        r = _uncompress_file(temp, mrs->_files[index].dh.h.compressed_size, buf, mrs->_files[index].dh.h.uncompressed_size, out_size);
+        if(_mrs_cache_get(mrs, f, buf))
+            return MRSE_OK;
+        // If it's mapped, we can inflate it right from there
+        ptr = _mrs_file_ptr(mrs, f);
+        if(ptr){
+            r = _mrs_inflate(mrs, (const unsigned char*)ptr, f->dh.h.compressed_size, buf, f->dh.h.uncompressed_size);
+        }else{
+            temp = (unsigned char*)malloc(mrs->_files[index].dh.h.compressed_size ? mrs->_files[index].dh.h.compressed_size : 1);
+            if(!temp)
+                return MRSE_INSUFFICIENT_MEM;
+            if(!_mrs_file_read(mrs, f, temp)){
+                free(temp);
+                return MRSE_CANNOT_OPEN;
+            }
+            r = _mrs_inflate(mrs, temp, mrs->_files[index].dh.h.compressed_size, buf, mrs->_files[index].dh.h.uncompressed_size);
+            free(temp);
+        }
         if(r)
-            r = MRSE_CANNOT_UNCOMPRESS;
-        free(temp);
+            return MRSE_CANNOT_UNCOMPRESS;
     }
 
+    _mrs_cache_put(mrs, f, buf, f->dh.h.uncompressed_size, 0);
+
     return r;
 }
 
+int mrs_read_view(const MRS* mrs, unsigned index, const unsigned char** ptr, size_t* len){
+    const unsigned char* p;
+    struct mrs_file_t* f;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(!ptr)
+        return MRSE_INVALID_PARAM;
+
+    if(index >= mrs->_hdr.dir_count)
+        return MRSE_INVALID_INDEX;
+
+    f = &mrs->_files[index];
+
+    if(f->dh.h.compression != MRSCM_STORE){
+        dbgprintf("File %u is compressed, no view for it", index);
+        return MRSE_UNSUPPORTED;
+    }
+
+    // Only `compressed_size` bytes of it are known to be there
+    if(f->dh.h.compressed_size != f->dh.h.uncompressed_size)
+        return MRSE_INVALID_MRS;
+
+    if(!f->dh.h.uncompressed_size){
+        *ptr = (const unsigned char*)"";
+        if(len)
+            *len = 0;
+        return MRSE_OK;
+    }
+
+    p = _mrs_file_ptr(mrs, f);
+    if(!p){
+        dbgprintf("File %u is not in memory (or needs decryption), no view for it", index);
+        return MRSE_UNSUPPORTED;
+    }
+
+    *ptr = p;
+    if(len)
+        *len = f->dh.h.uncompressed_size;
+
+    return MRSE_OK;
+}
+
 int mrs_get_file_info(const MRS* mrs, unsigned index, enum mrs_file_info_t what, void* buf, size_t buf_size, size_t* out_size){
     struct mrs_file_t* f;
 
@@ -426,6 +635,8 @@ int mrs_get_file_info(const MRS* mrs, unsigned index, enum mrs_file_info_t what,
         *(uint32_t*)buf = f->dh.h.crc32;
         break;
     case MRSFI_LHEXTRA:
+        if(!_mrs_file_resolve(mrs, f))
+            return MRSE_INVALID_ENCRYPTION;
         if(out_size)
             *out_size = f->lh.extra ? f->lh.h.extra_length : 0;
         if(buf_size < f->lh.h.extra_length || !buf)
@@ -452,6 +663,13 @@ int mrs_get_file_info(const MRS* mrs, unsigned index, enum mrs_file_info_t what,
             return MRSE_INFO_NOT_AVAILABLE;
         memcpy(buf, f->dh.comment, f->dh.h.comment_length);
         break;
+    case MRSFI_COMPRESSION:
+        if(out_size)
+            *out_size = sizeof(struct mrs_compression_t);
+        if(buf_size < sizeof(struct mrs_compression_t) || !buf)
+            return MRSE_INSUFFICIENT_MEM;
+        memcpy(buf, _mrs_file_compression(mrs, f), sizeof(struct mrs_compression_t));
+        break;
     default:
         return MRSE_INVALID_PARAM;
     }
@@ -466,45 +684,61 @@ size_t mrs_get_file_count(const MRS* mrs){
     return mrs->_hdr.dir_count;
 }
 
-int mrs_write(MRS* mrs, unsigned index, const unsigned char* buf, size_t buf_size){
-    unsigned char* temp = NULL;
-    size_t stemp;
-    struct mrs_file_t* f;
+/**< Writes `buf` to file `index` of `mrs`, compressed as `c` says. */
+int _mrs_write(MRS* mrs, unsigned index, const unsigned char* buf, size_t buf_size, const struct mrs_compression_t* c){
+    struct mrs_packed_t p;
+    struct mrs_file_t* f = &mrs->_files[index];
+    off_t  offset;
+    int e;
 
-    if(!_mrs_is_initialized(mrs))
-        return MRSE_UNITIALIZED;
-
-    if(index >= mrs->_hdr.dir_count)
-        return MRSE_INVALID_INDEX;
-    
-    f = &mrs->_files[index];
+    // Keeps its local header extra
+    if(!_mrs_file_resolve(mrs, f))
+        return MRSE_INVALID_ENCRYPTION;
 
-    f->dh.h.crc32 = crc32(0L, Z_NULL, 0);
-    f->dh.h.crc32 = crc32(f->dh.h.crc32, buf, buf_size);
-    f->lh.h.crc32 = f->dh.h.crc32;
+    e = _mrs_pack(mrs, c, buf, buf_size, f->dh.filename, &p);
+    if(e != MRSE_OK)
+        return e;
 
-    f->lh.h.uncompressed_size = f->dh.h.uncompressed_size = buf_size;
-    
-    if(!_compress_file(buf, buf_size, &temp, &stemp)){
-        dbgprintf("Could not compress, let's just STORE instead");
-        f->lh.h.compression = f->dh.h.compression = MRSCM_STORE;
-        f->lh.h.compressed_size = f->dh.h.compressed_size = buf_size;
-    }else{
-        f->lh.h.compression = f->dh.h.compression = MRSCM_DEFLATE;
-        f->lh.h.compressed_size = f->dh.h.compressed_size = stemp;
+    // The new buffer goes to the temporary storage, even if the old one was read from an archive.
+    // It's written before anything of `f` changes, so `f` is still the old file if it can't be
+    offset = _mrs_temp_tell(mrs);
+    if(!_mrs_temp_write(mrs, p.buf, p.csize)){
+        free(p.buf);
+        return MRSE_INSUFFICIENT_MEM;
     }
+    free(p.buf);
 
-    f->dh.h.offset = _mrs_temp_tell(mrs);
+    _mrs_cache_drop(mrs, f);
+    _mrs_temp_release(mrs, f);
 
-    _mrs_temp_write(mrs, temp ? temp : buf, f->dh.h.compressed_size);
+    f->lh.h.crc32 = f->dh.h.crc32 = p.crc32;
+
+    f->lh.h.uncompressed_size = f->dh.h.uncompressed_size = buf_size;
+    f->lh.h.compression = f->dh.h.compression = p.compression;
+    f->lh.h.compressed_size = f->dh.h.compressed_size = p.csize;
+
+    _mrs_source_release(mrs, f->src);
+    _mrs_file_drop_index(f);
+    f->src = 0;
+    f->dh.h.offset = offset;
 
     dbgprintf("Ok, we good to go");
 
-    free(temp);
+    _mrs_compact_auto(mrs);
 
     return MRSE_OK;
 }
 
+int mrs_write(MRS* mrs, unsigned index, const unsigned char* buf, size_t buf_size){
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(index >= mrs->_hdr.dir_count)
+        return MRSE_INVALID_INDEX;
+
+    return _mrs_write(mrs, index, buf, buf_size, _mrs_file_compression(mrs, &mrs->_files[index]));
+}
+
 int mrs_set_signature_check(MRS* mrs, MRS_SIGNATURE_FUNC f){
     if(!_mrs_is_initialized(mrs))
         return MRSE_UNITIALIZED;
@@ -541,6 +775,10 @@ int mrs_remove(MRS* mrs, unsigned index){
     
     f = &mrs->_files[index];
 
+    _mrs_cache_drop(mrs, f);
+    _mrs_temp_release(mrs, f);
+    _mrs_source_release(mrs, f->src);
+    _mrs_index_forget(mrs, index);
     _mrs_file_free(f);
 
     dbgprintf("Removing file %u", index);
@@ -550,17 +788,19 @@ int mrs_remove(MRS* mrs, unsigned index){
         if(index+1 < mrs->_hdr.dir_count)
             memmove(f, f+1, (mrs->_hdr.dir_count - index - 1)*sizeof(struct mrs_file_t));
         memset(&mrs->_files[mrs->_hdr.dir_count - 1], 0, sizeof(struct mrs_file_t));
-        mrs->_files = (struct mrs_file_t*)realloc(mrs->_files, (mrs->_hdr.dir_count - 1)*sizeof(struct mrs_file_t));
     }else{
         dbgprintf("We had only 1 file, so let's just free our files pointer");
         free(mrs->_files);
         mrs->_files = NULL;
+        mrs->_files_cap = 0;
     }
 
     dbgprintf("Removed file %u", index);
 
     mrs->_hdr.dir_count--;
 
+    _mrs_compact_auto(mrs);
+
     return MRSE_OK;
 }
 
@@ -569,20 +809,23 @@ int mrs_find_file(const MRS* mrs, const char* s, unsigned* index){
 
     if(!_mrs_is_initialized(mrs))
         return MRSE_UNITIALIZED;
+
+    if(!s)
+        return MRSE_INVALID_PARAM;
     
-    for(i=0; i<mrs->_hdr.dir_count; i++){
-        if(!stricmp(s, mrs->_files[i].dh.filename)){
-            if(index)
-                *index = i;
-            return MRSE_OK;
-        }
-    }
+    if(!_mrs_index_find(mrs, s, &i))
+        return MRSE_NOT_FOUND;
 
-    return MRSE_NOT_FOUND;
+    if(index)
+        *index = i;
+
+    return MRSE_OK;
 }
 
 int mrs_set_file_info(MRS* mrs, unsigned index, enum mrs_file_info_t what, const void* buf, size_t buf_size){
     struct mrs_file_t* f;
+    char*              name;
+    unsigned           i;
 
     if(!_mrs_is_initialized(mrs))
         return MRSE_UNITIALIZED;
@@ -596,14 +839,35 @@ int mrs_set_file_info(MRS* mrs, unsigned index, enum mrs_file_info_t what, const
     case MRSFI_NAME:
         if(!buf || !buf_size)
             return MRSE_INVALID_FILENAME;
-        if(!_is_valid_input_filename((const char*)buf))
+        // `buf_size` may or may not count the terminating null
+        buf_size = strnlen((const char*)buf, buf_size);
+        // The new name is made before anything of `f` changes, so `f` keeps the old one if it can't be
+        name = (char*)malloc(buf_size + 1);
+        if(!name)
+            return MRSE_INSUFFICIENT_MEM;
+        memcpy(name, buf, buf_size);
+        name[buf_size] = 0;
+        if(_is_valid_input_filename(name)){
+            free(name);
             return MRSE_INVALID_FILENAME;
-        /// TODO: CHECK FOR DUPLICATES
-        /// TODO: CHECK FOR DUPLICATES
-        f->dh.filename = (char*)realloc(f->dh.filename, buf_size);
-        memcpy(f->dh.filename, buf, buf_size);
+        }
+        // Out of the index first, so the file isn't a duplicate of itself
+        _mrs_index_remove(mrs, index);
+        if(_mrs_index_find(mrs, name, &i)){
+            dbgprintf("\"%s\" is the name of file %u already", name, i);
+            _mrs_index_add(mrs, index);
+            free(name);
+            return MRSE_DUPLICATE;
+        }
+        // A pooled name stays in the pool
+        if(f->flags & MRSFF_NAME_POOLED)
+            _mrs_file_clear_flags(f, MRSFF_NAME_POOLED);
+        else
+            free(f->dh.filename);
+        f->dh.filename = name;
         f->lh.filename = f->dh.filename;
         f->lh.h.filename_length = f->dh.h.filename_length = buf_size;
+        _mrs_index_add(mrs, index);
         break;
     case MRSFI_TIME:
         if(buf_size < sizeof(time_t))
@@ -613,6 +877,8 @@ int mrs_set_file_info(MRS* mrs, unsigned index, enum mrs_file_info_t what, const
         f->lh.h.filetime = f->dh.h.filetime;
         break;
     case MRSFI_LHEXTRA:
+        if(!_mrs_file_resolve(mrs, f))
+            return MRSE_INVALID_ENCRYPTION;
         _mrs_ref_table_free(&mrs->_reftable, f->lh.extra);
         if(!buf || !buf_size){
             f->lh.extra = NULL;
@@ -656,6 +922,10 @@ int mrs_set_file_info(MRS* mrs, unsigned index, enum mrs_file_info_t what, const
             memcpy(f->dh.comment, buf, buf_size);*/
         }
         break;
+    case MRSFI_COMPRESSION:
+        if(buf && buf_size < sizeof(struct mrs_compression_t))
+            return MRSE_INSUFFICIENT_MEM;
+        return _mrs_set_file_compression(mrs, index, (const struct mrs_compression_t*)buf);
     default:
         return MRSE_INVALID_PARAM;
     }
@@ -672,7 +942,9 @@ int mrs_save(MRS* mrs, enum mrs_save_t type, const char* output, MRS_PROGRESS_FU
 
     switch(type){
     case MRSS_MRS:
-        return _mrs_save_mrs_fname(mrs, output, pcallback);
+        return _mrs_save_mrs_fname(mrs, output, 0, pcallback);
+    case MRSS_MRS_INCREMENTAL:
+        return _mrs_save_mrs_fname(mrs, output, 1, pcallback);
     case MRSS_FOLDER:
         return _mrs_save_folder(mrs, output, pcallback);
     }
@@ -692,6 +964,25 @@ int mrs_save_mrs_fp(MRS* mrs, FILE* output, MRS_PROGRESS_FUNC pcallback){
     return MRSE_INVALID_PARAM;
 }
 
+int mrs_set_incremental_threshold(MRS* mrs, unsigned percent){
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(percent > 100)
+        return MRSE_INVALID_PARAM;
+
+    dbgprintf("Setting incremental save threshold to %u%%", percent);
+    mrs->_inc_threshold = percent;
+
+    return MRSE_OK;
+}
+
+void mrs_thread_cleanup(){
+    dbgprintf("Freeing the zlib streams of this thread");
+    _mrs_thread_cleanup();
+    _mrs_codec_thread_cleanup();
+}
+
 void mrs_free(MRS* mrs){
     unsigned i;
     if(!_mrs_is_initialized(mrs)){
@@ -711,6 +1002,16 @@ void mrs_free(MRS* mrs){
         free(mrs->_files);
         dbgprintf("Freed our files");
     }
+    _mrs_pool_free(&mrs->_pool);
+    _mrs_index_free(mrs);
+    _mrs_stems_free(mrs);
+    _mrs_names_free(mrs);
+    _mrs_bloom_free(mrs);
+
+    _mrs_cache_free(mrs);
+    free(mrs->_ccache);
+    _mrs_source_free_all(&mrs->_srcs);
+    _mrs_lock_free(mrs);
 
     if(mrs->_mtype == MRSMT_TEMPFILE){
         dbgprintf("We were using a temporary file, so let's close it");
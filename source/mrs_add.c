@@ -31,8 +31,8 @@
     and variables
 *******************************/
 
-                  /// FROM mrs_util.c
-           extern int _compress_file(unsigned char* inbuf, size_t total_in, unsigned char** outbuf, size_t* total_out);
+                  /// FROM mrs_compress.c
+           extern int _mrs_pack(const MRS* mrs, const struct mrs_compression_t* c, const void* buffer, size_t buffer_size, const char* name, struct mrs_packed_t* p);
                   /// FROM utils.c
            extern int _is_valid_input_filename(const char* s);
                   /// FROM mrs_util.c
@@ -42,11 +42,17 @@
                   /// FROM mrs_file.c
           extern void _mrs_file_init(struct mrs_file_t* f);
                   /// FROM mrs_file.c
-          extern void _mrs_files_append(struct mrs_files_t* f, const struct mrs_file_t* ff);
+          extern int _mrs_files_append(struct mrs_files_t* f, const struct mrs_file_t* ff);
                   /// FROM mrs_file.c
           extern void _mrs_files_destroy(struct mrs_files_t* f, int freefiles);
                   /// FROM mrs_file.c
           extern void _mrs_files_init(struct mrs_files_t* f);
+                  /// FROM mrs_file.c
+           extern int _mrs_files_reserve(struct mrs_files_t* f, size_t n);
+                  /// FROM mrs_pool.c
+           extern int _mrs_pool_reserve(struct mrs_pool_t* p, size_t size);
+                  /// FROM mrs_pool.c
+         extern char* _mrs_pool_alloc(struct mrs_pool_t* p, size_t size);
                   /// FROM mrs_util.c
            extern int _mrs_is_duplicate(const MRS* mrs, const char* s, char** s_out, unsigned* match_index);
                   /// FROM mrs_util.c
@@ -54,7 +60,9 @@
                   /// FROM mrs_util.c
           extern void mrs_local_hdr(struct mrs_local_hdr_t* lh, uint32_t signature, uint16_t version, uint16_t flags, uint16_t compression, struct dostime_t filetime, uint32_t crc32, uint32_t compressed_size, uint32_t uncompressed_size, uint16_t filename_length, uint16_t extra_length);
                   /// FROM mrs_util.c
-          extern void _mrs_push_file(MRS* mrs, const struct mrs_file_t f);
+          extern int _mrs_push_file(MRS* mrs, const struct mrs_file_t f);
+                  /// FROM mrs_util.c
+           extern int _mrs_reserve_files(MRS* mrs, size_t n);
                   /// FROM mrs_ref_table.c
 extern unsigned char* _mrs_ref_table_append(struct mrs_ref_table_t* r, const unsigned char* s, size_t len);
                   /// FROM mrs_ref_table.c
@@ -62,13 +70,15 @@ extern unsigned char* _mrs_ref_table_append(struct mrs_ref_table_t* r, const uns
                   /// FROM mrs_ref_table.c
           extern void _mrs_ref_table_init(struct mrs_ref_table_t* r);
                   /// FROM mrs_util.c
-           extern int _mrs_temp_read(MRS* mrs, unsigned char* buf, off_t offset, size_t size);
+           extern int _mrs_temp_read(const MRS* mrs, unsigned char* buf, off_t offset, size_t size);
                   /// FROM mrs_util.c
          extern off_t _mrs_temp_tell(MRS* mrs);
                   /// FROM mrs_util.c
            extern int _mrs_temp_write(MRS* mrs, unsigned char* buf, size_t size);
                   /// FROM mrs_util.c
            extern int _mrs_replace_file(MRS* mrs, struct mrs_file_t* oldf, struct mrs_file_t* newf);
+                  /// FROM mrs_ingest.c
+           extern int _mrs_add_paths(MRS* mrs, struct mrs_ingest_job_t* jobs, size_t count, void* reserved, enum mrs_dupe_behavior_t on_dupe, struct mrs_files_t* files, struct mrs_replace_index_list_t* ridxl);
                   /// FROM mrs_replace_index.c
           extern void _mrs_replace_index_list_add(struct mrs_replace_index_list_t* il, unsigned oldi, unsigned newi);
                   /// FROM mrs_replace_index.c
@@ -81,6 +91,22 @@ extern unsigned char* _mrs_ref_table_append(struct mrs_ref_table_t* r, const uns
           extern void _mrs_replace_index_list_init(struct mrs_replace_index_list_t* il);
                   /// FROM utils.c
            extern int _strslash(char* s, size_t size);
+                  /// FROM mrs_util.c
+           extern int _mrs_file_read(const MRS* mrs, struct mrs_file_t* f, unsigned char* buf);
+                  /// FROM mrs_source.c
+           extern int _mrs_file_resolve(const MRS* mrs, struct mrs_file_t* f);
+                  /// FROM mrs_source.c
+           extern int _mrs_source_open(MRS* mrs, const char* name, MRS_ENCRYPTION_FUNC dec, MRS_ENCRYPTION_FUNC lhdec, int map, unsigned* src);
+                  /// FROM mrs_source.c
+           extern int _mrs_source_open_memory(MRS* mrs, const unsigned char* buf, size_t size, MRS_ENCRYPTION_FUNC dec, MRS_ENCRYPTION_FUNC lhdec, unsigned* src);
+                  /// FROM mrs_source.c
+           extern int _mrs_source_read(const MRS* mrs, unsigned src, unsigned char* buf, off_t offset, size_t size);
+                  /// FROM mrs_source.c
+          extern void _mrs_source_ref(MRS* mrs, unsigned src);
+                  /// FROM mrs_source.c
+          extern void _mrs_source_release(MRS* mrs, unsigned src);
+                  /// FROM mrs_util.c
+          extern void _mrs_temp_release(MRS* mrs, const struct mrs_file_t* f);
 
 #ifdef _LIBMRS_DBG
                   /// FROM mrs_dbg.c
@@ -92,33 +118,26 @@ extern unsigned char* _mrs_ref_table_append(struct mrs_ref_table_t* r, const uns
 #define mrs_local_hdr_dump(...)
 #endif
 
-int _mrs_add_memory(MRS* mrs, const void* buffer, size_t buffer_size,
-                    const char* name, const time_t* timep, void* reserved,
-                    enum mrs_dupe_behavior_t on_dupe, int check_name, int check_dup,
-                    int pushit, struct mrs_file_t* f_out, int *isreplace, int* replaceindex){
-    struct mrs_file_t f;
-    char*             final_name;
-    char*             temp;
-    unsigned char*    ubuf      = NULL;
-    unsigned char*    cbuf      = NULL;
-    unsigned          dup       = 0;
-    unsigned          dup_index = 0;
-    int               e;
-    time_t            timepp = timep ? *timep : time(NULL);
+/**< Checks `name` and whether `mrs` has a file with it already, giving the name the file will have in `final_name`. */
+int _mrs_add_check(MRS* mrs, const char* name, enum mrs_dupe_behavior_t on_dupe, int check_name, int check_dup,
+                   char** final_name, unsigned* dup, unsigned* dup_index, int* isreplace){
+    char* temp;
 
     if(!name){
         dbgprintf("name was not given, leaving...");
         return MRSE_INVALID_PARAM;
     }
 
-    final_name = strdup(name);
+    *final_name = strdup(name);
+    *dup        = 0;
+    *dup_index  = 0;
 
     if(check_name){
-        _strslash(final_name, 0);
+        _strslash(*final_name, 0);
         
-        if(_is_valid_input_filename(final_name)){
+        if(_is_valid_input_filename(*final_name)){
             dbgprintf("Invalid final filename");
-            free(final_name);
+            free(*final_name);
             return MRSE_INVALID_FILENAME;
         }
     }
@@ -128,27 +147,27 @@ int _mrs_add_memory(MRS* mrs, const void* buffer, size_t buffer_size,
     
     if(check_dup){
         if(mrs->_hdr.dir_count){
-            dup = _mrs_is_duplicate(mrs, final_name, &temp, &dup_index);
-            if(!dup){
+            *dup = _mrs_is_duplicate(mrs, *final_name, &temp, dup_index);
+            if(!*dup){
                 dbgprintf("Found duplicate");
                 switch(on_dupe){
                 case MRSDB_KEEP_NEW:
                     dbgprintf(" Let's keep the new one");
                     free(temp);
                     temp = NULL;
-                    dup = -1;
+                    *dup = -1;
                     if (isreplace)
                         *isreplace = 1;
                     break;
                 case MRSDB_KEEP_OLD:
                     dbgprintf(" Let's keep the old one");
                     free(temp);
-                    free(final_name);
+                    free(*final_name);
                     return MRSE_DUPLICATE;
                 case MRSDB_KEEP_BOTH:
                     dbgprintf(" Let's keep both files");
-                    free(final_name);
-                    final_name = temp;
+                    free(*final_name);
+                    *final_name = temp;
                     temp = NULL;
                     break;
                 }
@@ -156,6 +175,18 @@ int _mrs_add_memory(MRS* mrs, const void* buffer, size_t buffer_size,
         }
     }
 
+    return MRSE_OK;
+}
+
+/**
+ * Writes the buffer packed in `p` to the temporary storage and makes the file `final_name` of it (which it takes).
+ * `dup` and `dup_index` are the ones given by `_mrs_add_check`.
+ */
+int _mrs_add_packed(MRS* mrs, struct mrs_packed_t* p, char* final_name, const time_t* timep, enum mrs_dupe_behavior_t on_dupe,
+                    int check_dup, unsigned dup, unsigned dup_index, int pushit, struct mrs_file_t* f_out, int* replaceindex){
+    struct mrs_file_t f;
+    time_t            timepp = timep ? *timep : time(NULL);
+
     _mrs_file_init(&f);
 
     mrs_central_dir_hdr(&f.dh.h,                //// CENTRAL DIR HEADER
@@ -163,12 +194,12 @@ int _mrs_add_memory(MRS* mrs, const void* buffer, size_t buffer_size,
                             MRSV_CDIR_MADE,     // version made
                             MRSV_CDIR_NEEDED,   // version needed
                             0,                  // flags
-                            MRSCM_DEFLATE,      // compression method
-                            dostime(&timep),    // filetime
-                            0,                  // crc32
-                            0,                  // compressed size
-                            buffer_size,        // uncompressed size
-                            0,                  // filename length
+                            p->compression,     // compression method
+                            dostime(&timepp),   // filetime
+                            p->crc32,           // crc32
+                            p->csize,           // compressed size
+                            p->size,            // uncompressed size
+                            strlen(final_name), // filename length
                             0,                  // extra length
                             0,                  // comment length
                             0,                  // disk start
@@ -180,47 +211,27 @@ int _mrs_add_memory(MRS* mrs, const void* buffer, size_t buffer_size,
                     MRSM_LOCAL_MAGIC1,          // signature
                     MRSV_LOCAL,                 // version
                     0,                          // flags
-                    MRSCM_DEFLATE,              // compression method
-                    dostime(&timep),            // filetime
-                    0,                          // crc32
-                    0,                          // compressed size
-                    buffer_size,                // uncompressed size
-                    0,                          // filename length
+                    p->compression,             // compression method
+                    dostime(&timepp),           // filetime
+                    p->crc32,                   // crc32
+                    p->csize,                   // compressed size
+                    p->size,                    // uncompressed size
+                    strlen(final_name),         // filename length
                     0);                         // extra length
 
-    ubuf = (unsigned char*)malloc(buffer_size);
-    memcpy(ubuf, buffer, buffer_size);
-
-    f.dh.h.crc32 = crc32(0, Z_NULL, 0);
-    if(f.dh.h.uncompressed_size)
-        f.dh.h.crc32 = crc32(f.dh.h.crc32, ubuf, f.dh.h.uncompressed_size);
-    f.lh.h.crc32 = f.dh.h.crc32;
-
-    if(f.dh.h.uncompressed_size){
-        e = _compress_file(buffer, buffer_size, &cbuf, &f.dh.h.compressed_size);
-        if(!e){
-            cbuf = ubuf;
-            ubuf = NULL;
-            f.dh.h.compressed_size = f.dh.h.uncompressed_size;
-            f.dh.h.compression = MRSCM_STORE;
-        }
-    }else{
-        f.dh.h.compressed_size = f.dh.h.uncompressed_size;
-        f.dh.h.compression = MRSCM_STORE;
-    }
-    
-    f.lh.h.compressed_size = f.dh.h.compressed_size;    // local header compressed file size
-    f.lh.h.compression     = f.dh.h.compression;        // local header compression method
-
-    if(ubuf)
-        free(ubuf);
-
     f.lh.filename = f.dh.filename = final_name;
     f.dh.h.offset = _mrs_temp_tell(mrs);
 
-    _mrs_temp_write(mrs, cbuf, f.dh.h.compressed_size);
+    if(!_mrs_temp_write(mrs, p->buf, p->csize)){
+        dbgprintf("Could not write the file buffer to the temporary storage");
+        free(p->buf);
+        p->buf = NULL;
+        free(final_name);
+        return MRSE_INSUFFICIENT_MEM;
+    }
 
-    free(cbuf);
+    free(p->buf);
+    p->buf = NULL;
 
     if(check_dup){
         if(dup == -1 && on_dupe == MRSDB_KEEP_NEW){
@@ -232,20 +243,29 @@ int _mrs_add_memory(MRS* mrs, const void* buffer, size_t buffer_size,
                     *replaceindex = dup_index;
                 if (f_out)
                     memcpy(f_out, &f, sizeof(struct mrs_file_t));
-                else
+                else {
+                    _mrs_temp_release(mrs, &f);
                     _mrs_file_free(&f);
+                }
             }
         }else{
             if (pushit) {
-                _mrs_push_file(mrs, f);
+                if(!_mrs_push_file(mrs, f)){
+                    dbgprintf("Could not append the file to the MRS handle");
+                    _mrs_temp_release(mrs, &f);
+                    _mrs_file_free(&f);
+                    return MRSE_INSUFFICIENT_MEM;
+                }
                 dbgprintf("OK, file appended to the MRS handle!");
             }
             else {
                 dbgprintf("File will not be appended to the MRS handle!");
                 if (f_out)
                     memcpy(f_out, &f, sizeof(struct mrs_file_t));
-                else
+                else {
+                    _mrs_temp_release(mrs, &f);
                     _mrs_file_free(&f);
+                }
             }
         }
     }
@@ -253,6 +273,28 @@ int _mrs_add_memory(MRS* mrs, const void* buffer, size_t buffer_size,
     return MRSE_OK;
 }
 
+int _mrs_add_memory(MRS* mrs, const void* buffer, size_t buffer_size,
+                    const char* name, const time_t* timep, void* reserved,
+                    enum mrs_dupe_behavior_t on_dupe, int check_name, int check_dup,
+                    int pushit, struct mrs_file_t* f_out, int *isreplace, int* replaceindex){
+    struct mrs_packed_t p;
+    char*               final_name;
+    unsigned            dup, dup_index;
+    int                 e;
+
+    e = _mrs_add_check(mrs, name, on_dupe, check_name, check_dup, &final_name, &dup, &dup_index, isreplace);
+    if(e != MRSE_OK)
+        return e;
+
+    e = _mrs_pack(mrs, &mrs->_comp, buffer, buffer_size, final_name, &p);
+    if(e != MRSE_OK){
+        free(final_name);
+        return e;
+    }
+
+    return _mrs_add_packed(mrs, &p, final_name, timep, on_dupe, check_dup, dup, dup_index, pushit, f_out, replaceindex);
+}
+
 /// TODO: Check if the file descriptor is READABLE
 int _mrs_add_filedes(MRS* mrs, int fd, char* filename, void* reserved, enum mrs_dupe_behavior_t on_dupe, int check_name, int check_dup, int pushit, struct mrs_file_t* f_out, int *isreplace, int *replaceindex){
     char*          final_name;
@@ -420,9 +462,8 @@ int _mrs_add_file(MRS* mrs, const char* filename, char* final_name, void* reserv
 
     fd = open(filename, O_RDONLY | O_BINARY);
     if(fd == -1){
-        free(temp);
-        free(filename);
         dbgprintf("%s: File not found", filename);
+        free(final_name);
         return MRSE_NOT_FOUND;
     }
 
@@ -433,7 +474,7 @@ int _mrs_add_file(MRS* mrs, const char* filename, char* final_name, void* reserv
 
     close(fd);
 
-    return MRSE_OK;
+    return e;
 }
 
 int _mrs_add_folder(MRS* mrs, const char* foldername, char* base_name, void* reserved, enum mrs_dupe_behavior_t on_dupe) {
@@ -446,8 +487,10 @@ int _mrs_add_folder(MRS* mrs, const char* foldername, char* base_name, void* res
     char*            path;
     char*            temp;
     struct mrs_files_t files;
-    struct mrs_file_t  f;
-    int isreplace, ridx, e;
+    struct mrs_ingest_job_t* jobs;
+    struct mrs_ingest_job_t* more;
+    size_t           jobs_count, jobs_cap;
+    int e = MRSE_OK;
     struct mrs_replace_index_list_t ridxl;
 
     if (!PathFileExistsA(foldername)) {
@@ -470,6 +513,8 @@ int _mrs_add_folder(MRS* mrs, const char* foldername, char* base_name, void* res
 
     _mrs_files_init(&files);
     _mrs_replace_index_list_init(&ridxl);
+    jobs = NULL;
+    jobs_count = jobs_cap = 0;
     i = 0;
     while (i < path_list_count) {
         h = FindFirstFileA(path_list[i], &fda);
@@ -479,6 +524,7 @@ int _mrs_add_folder(MRS* mrs, const char* foldername, char* base_name, void* res
                 free(path_list);
                 return MRSE_EMPTY_FOLDER;
             }
+            i++;
             continue;
         }
         do {
@@ -487,9 +533,9 @@ int _mrs_add_folder(MRS* mrs, const char* foldername, char* base_name, void* res
             if (fda.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
                 dbgprintf("<Found directory>");
                 path_list = (char**)realloc(path_list, sizeof(char*) * (path_list_count + 1));
-                len = _scprintf("%.*s\\%s\\*", strlen(path_list[i]) - 2, path_list[i], fda.cFileName);
+                len = _scprintf("%.*s%s\\*", strlen(path_list[i]) - 1, path_list[i], fda.cFileName);
                 temp = (char*)malloc(len + 1);
-                sprintf(temp, "%.*s\\%s\\*", strlen(path_list[i]) - 1, path_list[i], fda.cFileName);
+                sprintf(temp, "%.*s%s\\*", strlen(path_list[i]) - 1, path_list[i], fda.cFileName);
                 path_list[path_list_count] = temp;
                 dbgprintf("  <%s>", path_list[path_list_count]);
                 path_list_count++;
@@ -511,26 +557,27 @@ int _mrs_add_folder(MRS* mrs, const char* foldername, char* base_name, void* res
             sprintf(path, "%.*s%s", strlen(path_list[i]) - 1, path_list[i], fda.cFileName);
             dbgprintf(" TEMP=<%s>", temp);
             dbgprintf(" PATH=<%s>", path);
-            isreplace = 0;
-            e = _mrs_add_file(mrs, path, temp, reserved, on_dupe, 0, &f, on_dupe == MRSDB_KEEP_NEW ? &isreplace : NULL, on_dupe == MRSDB_KEEP_NEW ? &ridx : NULL);
-            free(temp);
-            free(path);
-            temp = path = NULL;
-            if (e) {
-                dbgprintf("   Error -> %u", e);
-                for (i = 0; i < path_list_count; i++)
-                    free(path_list[i]);
-                free(path_list);
-                _mrs_replace_index_list_free(&ridxl);
-                _mrs_files_destroy(&files, 1);
-                return e;
-            }
-            else {
-                if (on_dupe == MRSDB_KEEP_NEW && isreplace)
-                    _mrs_replace_index_list_add(&ridxl, ridx, ridxl.cnt);
-                _mrs_files_append(&files, &f);
+            // Files are only listed here, they're read (and packed) all together afterwards
+            if (jobs_count == jobs_cap) {
+                more = (struct mrs_ingest_job_t*)realloc(jobs, (jobs_cap ? jobs_cap * 2 : 64) * sizeof(struct mrs_ingest_job_t));
+                if (!more) {
+                    free(path);
+                    free(temp);
+                    e = MRSE_INSUFFICIENT_MEM;
+                    break;
+                }
+                jobs = more;
+                jobs_cap = jobs_cap ? jobs_cap * 2 : 64;
             }
+            memset(&jobs[jobs_count], 0, sizeof(struct mrs_ingest_job_t));
+            jobs[jobs_count].path = path;
+            jobs[jobs_count].name = temp;
+            jobs_count++;
+            temp = path = NULL;
         } while (FindNextFileA(h, &fda));
+        FindClose(h);
+        if (e)
+            break;
         i++;
     }
     
@@ -538,9 +585,34 @@ int _mrs_add_folder(MRS* mrs, const char* foldername, char* base_name, void* res
         free(path_list[i]);
     free(path_list);
 
+    if (!e)
+        e = _mrs_add_paths(mrs, jobs, jobs_count, reserved, on_dupe, &files, &ridxl);
+
+    for (i = 0; i < jobs_count; i++) {
+        free((char*)jobs[i].path);
+        free((char*)jobs[i].name);
+    }
+    free(jobs);
+
+    if (e) {
+        dbgprintf("   Error -> %u", e);
+        _mrs_replace_index_list_free(&ridxl);
+        _mrs_files_destroy(&files, 1);
+        return e;
+    }
+
     dbgprintf("We got %u files", files.count);
     dbgprintf("%u files need to be replaced", ridxl.cnt);
 
+    // Room for all of them is made before any is pushed, so none is if there's no memory for it
+    if (!_mrs_reserve_files(mrs, mrs->_hdr.dir_count + files.count)) {
+        for (i = 0; i < files.count; i++)
+            _mrs_temp_release(mrs, &files.files[i]);
+        _mrs_replace_index_list_free(&ridxl);
+        _mrs_files_destroy(&files, 1);
+        return MRSE_INSUFFICIENT_MEM;
+    }
+
     for (i = 0; i < files.count; i++) {
         dbgprintf("[%s]", files.files[i].dh.filename);
         if (on_dupe == MRSDB_KEEP_NEW && ridxl.cnt) {
@@ -556,8 +628,35 @@ int _mrs_add_folder(MRS* mrs, const char* foldername, char* base_name, void* res
     return MRSE_OK;
 }
 
-int _mrs_add_mrs(MRS* mrs, const char* mrsname, char* base_name, void* reserved, enum mrs_dupe_behavior_t on_dupe) {
-    FILE* fp;
+/**< Copies the buffer of `f` in source `src` to the temporary storage (decrypted with `dec`, if given), where `f` points after. */
+static int _mrs_add_copy_buffer(MRS* mrs, unsigned src, struct mrs_file_t* f, MRS_ENCRYPTION_FUNC dec) {
+    unsigned char* temp;
+    int e = MRSE_OK;
+
+    temp = (unsigned char*)malloc(f->dh.h.compressed_size ? f->dh.h.compressed_size : 1);
+    if (!temp)
+        return MRSE_INSUFFICIENT_MEM;
+
+    if (!_mrs_source_read(mrs, src, temp, f->dh.h.offset, f->dh.h.compressed_size)) {
+        dbgprintf("Can't read file buffer @ %08x", f->dh.h.offset);
+        free(temp);
+        return MRSE_CANNOT_OPEN;
+    }
+    if (dec)
+        dec(temp, f->dh.h.compressed_size);
+
+    f->dh.h.offset = _mrs_temp_tell(mrs);
+    if (!_mrs_temp_write(mrs, temp, f->dh.h.compressed_size))
+        e = MRSE_INSUFFICIENT_MEM;
+    free(temp);
+
+    return e;
+}
+
+/**< Adds the files of the archive `mrsname`, or of the archive in `mem` (`mem_size` bytes) if `mem` is given. */
+static int _mrs_add_mrs_source(MRS* mrs, const char* mrsname, const unsigned char* mem, size_t mem_size, char* base_name, void* reserved, enum mrs_dupe_behavior_t on_dupe) {
+    unsigned src;
+    off_t lhoff;
     unsigned i;
     struct mrs_hdr_t hdr;
     struct mrs_encryption_t decrypt;
@@ -566,9 +665,14 @@ int _mrs_add_mrs(MRS* mrs, const char* mrsname, char* base_name, void* reserved,
     unsigned char* temp;
     unsigned char* temp2;
     unsigned char* dhbuf;
+    unsigned char* scratch = NULL;
+    size_t scratch_cap = 0;
+    size_t base_len;
+    size_t names;
     unsigned dup;
     unsigned dup_index;
     struct mrs_replace_index_list_t ridxl;
+    int e;
 
     if (base_name) {
         if (_is_valid_input_filename(base_name)) {
@@ -576,13 +680,13 @@ int _mrs_add_mrs(MRS* mrs, const char* mrsname, char* base_name, void* reserved,
             return MRSE_INVALID_FILENAME;
         }
     }
+    base_len = base_name ? strlen(base_name) + 1 : 0;
 
-    dbgprintf("Let's read a mrs file: \"%s\"", mrsname);
-
-    fp = fopen(mrsname, "rb");
-    if (!fp) {
-        dbgprintf("\"%s\" not found", mrsname);
-        return MRSE_NOT_FOUND;
+    if (mem) {
+        dbgprintf("Let's read a mrs file from memory: %u bytes", mem_size);
+    }
+    else {
+        dbgprintf("Let's read a mrs file: \"%s\"", mrsname);
     }
 
     decrypt.base_hdr = mrs->_dec.base_hdr ? mrs->_dec.base_hdr : mrs_default_decrypt;
@@ -590,31 +694,68 @@ int _mrs_add_mrs(MRS* mrs, const char* mrsname, char* base_name, void* reserved,
     decrypt.central_dir_hdr = mrs->_dec.central_dir_hdr ? mrs->_dec.central_dir_hdr : decrypt.base_hdr;
     decrypt.buffer = mrs->_dec.buffer;
 
-    fseek(fp, -(int)sizeof(struct mrs_hdr_t), SEEK_END);
-    fread(&hdr, sizeof(struct mrs_hdr_t), 1, fp);
+    if (mem)
+        e = _mrs_source_open_memory(mrs, mem, mem_size, decrypt.buffer, decrypt.local_hdr, &src);
+    else
+        e = _mrs_source_open(mrs, mrsname, decrypt.buffer, decrypt.local_hdr, mrs->_flags & MRSF_MMAP, &src);
+    if (e) {
+        dbgprintf("\"%s\" can't be opened", mrsname);
+        return e;
+    }
+
+    if (mrs->_srcs.srcs[src - 1].size < sizeof(struct mrs_hdr_t)) {
+        dbgprintf("  Too small to be a mrs file!");
+        _mrs_source_release(mrs, src);
+        return MRSE_INVALID_MRS;
+    }
+
+    if (!_mrs_source_read(mrs, src, (unsigned char*)&hdr, mrs->_srcs.srcs[src - 1].size - sizeof(struct mrs_hdr_t), sizeof(struct mrs_hdr_t))) {
+        dbgprintf("  Can't read the header!");
+        _mrs_source_release(mrs, src);
+        return MRSE_CANNOT_OPEN;
+    }
 
     decrypt.base_hdr((unsigned char*)&hdr, sizeof(struct mrs_hdr_t));
     dbgprintf("SIG = %08x", hdr.signature);
 
     if (!mrs_default_signatures(MRSSW_BASE_HDR, hdr.signature) && (!mrs->_sig || !mrs->_sig(MRSSW_BASE_HDR, hdr.signature))) {
         dbgprintf("  Invalid signature!");
-        fclose(fp);
+        _mrs_source_release(mrs, src);
         return MRSE_INVALID_MRS;
     }
 
     dbgprintf("We got %u file(s)", hdr.dir_count);
     _mrs_files_init(&ff);
     _mrs_replace_index_list_init(&ridxl);
+
+    // Everything is allocated up front: the file lists, and one pool block for all the names (they fit in what the dir has besides headers)
+    names = hdr.dir_size > hdr.dir_count * sizeof(struct mrs_central_dir_hdr_t) ? hdr.dir_size - hdr.dir_count * sizeof(struct mrs_central_dir_hdr_t) : 0;
+    names += hdr.dir_count * (base_len + 1);
+    if (!_mrs_files_reserve(&ff, hdr.dir_count) || !_mrs_reserve_files(mrs, mrs->_hdr.dir_count + hdr.dir_count) || !_mrs_pool_reserve(&mrs->_pool, names)) {
+        _mrs_files_destroy(&ff, 0);
+        _mrs_source_release(mrs, src);
+        return MRSE_INSUFFICIENT_MEM;
+    }
     
-    dhbuf = (char*)malloc(hdr.dir_size);
-    fseek(fp, hdr.dir_offset, SEEK_SET);
-    fread(dhbuf, hdr.dir_size, 1, fp);
+    dhbuf = (unsigned char*)malloc(hdr.dir_size ? hdr.dir_size : 1);
+    if (!dhbuf || !_mrs_source_read(mrs, src, dhbuf, hdr.dir_offset, hdr.dir_size)) {
+        dbgprintf("  Central dir is not where the header says");
+        free(dhbuf);
+        _mrs_files_destroy(&ff, 0);
+        _mrs_source_release(mrs, src);
+        return MRSE_INVALID_MRS;
+    }
     decrypt.central_dir_hdr(dhbuf, hdr.dir_size);
 
     temp = dhbuf;
     for (i = 0; i < hdr.dir_count; i++) {
         memset(&f, 0, sizeof(struct mrs_file_t));
-        memcpy(&f.dh.h, temp, sizeof(struct mrs_central_dir_hdr_t));
+        // An entry that doesn't fit in the dir fails the signature check below
+        if ((size_t)(temp - dhbuf) + sizeof(struct mrs_central_dir_hdr_t) <= hdr.dir_size) {
+            memcpy(&f.dh.h, temp, sizeof(struct mrs_central_dir_hdr_t));
+            if ((size_t)(temp - dhbuf) + sizeof(struct mrs_central_dir_hdr_t) + f.dh.h.filename_length + f.dh.h.extra_length + f.dh.h.comment_length > hdr.dir_size)
+                f.dh.h.signature = 0;
+        }
         dbgprintf("Central header signature = %08x", f.dh.h.signature);
 
         if (!mrs_default_signatures(MRSSW_CENTRAL_DIR_HDR, f.dh.h.signature) && (!mrs->_sig || !mrs->_sig(MRSSW_CENTRAL_DIR_HDR, f.dh.h.signature))) {
@@ -623,56 +764,81 @@ int _mrs_add_mrs(MRS* mrs, const char* mrsname, char* base_name, void* reserved,
             _mrs_files_destroy(&ff, 1);
             _mrs_file_free(&f);
             free(dhbuf);
-            fclose(fp);
+            free(scratch);
+            _mrs_source_release(mrs, src);
             return MRSE_INVALID_ENCRYPTION;
         }
 
-        fseek(fp, f.dh.h.offset, SEEK_SET);
-        fread(&f.lh.h, sizeof(struct mrs_local_hdr_t), 1, fp);
-        decrypt.local_hdr((unsigned char*)&f.lh.h, sizeof(struct mrs_local_hdr_t));
-        dbgprintf("Local header sig = %08x", f.lh.h.signature);
-        mrs_local_hdr_dump(&f.lh.h);
-
-        if (!mrs_default_signatures(MRSSW_LOCAL_HDR, f.lh.h.signature) && (!mrs->_sig || !mrs->_sig(MRSSW_LOCAL_HDR, f.lh.h.signature))) {
-            dbgprintf("Invalid local header encryption");
-            _mrs_replace_index_list_free(&ridxl);
-            _mrs_files_destroy(&ff, 1);
-            _mrs_file_free(&f);
-            free(dhbuf);
-            fclose(fp);
-            return MRSE_INVALID_ENCRYPTION;
+        lhoff = f.dh.h.offset;
+        if ((mrs->_flags & MRSF_TRUST_CDIR) && (mrs->_flags & (MRSF_LAZY | MRSF_MMAP))) {
+            // The local header is read when the file buffer is needed, till then it's what the central dir says
+            mrs_local_hdr(&f.lh.h, MRSM_LOCAL_MAGIC1, f.dh.h.version_needed, f.dh.h.flags, f.dh.h.compression, f.dh.h.filetime,
+                          f.dh.h.crc32, f.dh.h.compressed_size, f.dh.h.uncompressed_size, f.dh.h.filename_length, 0);
+            f.flags |= MRSFF_LH_PENDING;
         }
+        else {
+            // A local header that can't be read fails the signature check below
+            if (_mrs_source_read(mrs, src, (unsigned char*)&f.lh.h, lhoff, sizeof(struct mrs_local_hdr_t)))
+                decrypt.local_hdr((unsigned char*)&f.lh.h, sizeof(struct mrs_local_hdr_t));
+            else
+                f.lh.h.signature = 0;
+            dbgprintf("Local header sig = %08x", f.lh.h.signature);
+            mrs_local_hdr_dump(&f.lh.h);
+
+            if (!mrs_default_signatures(MRSSW_LOCAL_HDR, f.lh.h.signature) && (!mrs->_sig || !mrs->_sig(MRSSW_LOCAL_HDR, f.lh.h.signature))) {
+                dbgprintf("Invalid local header encryption");
+                _mrs_replace_index_list_free(&ridxl);
+                _mrs_files_destroy(&ff, 1);
+                _mrs_file_free(&f);
+                free(dhbuf);
+                free(scratch);
+                _mrs_source_release(mrs, src);
+                return MRSE_INVALID_ENCRYPTION;
+            }
 
-        fseek(fp, f.lh.h.filename_length, SEEK_CUR);
+            if (f.lh.h.extra_length) {
+                dbgprintf("We have Local extra, let's copy it");
+                // Read into the same scratch buffer every time, the ref table keeps its own copy (so what it had doesn't matter)
+                if (f.lh.h.extra_length > scratch_cap) {
+                    free(scratch);
+                    scratch = (unsigned char*)malloc(f.lh.h.extra_length);
+                    scratch_cap = scratch ? f.lh.h.extra_length : 0;
+                }
+                if (!scratch || !_mrs_source_read(mrs, src, scratch, lhoff + sizeof(struct mrs_local_hdr_t) + f.lh.h.filename_length, f.lh.h.extra_length)) {
+                    dbgprintf("Can't read local header extra");
+                    _mrs_replace_index_list_free(&ridxl);
+                    _mrs_files_destroy(&ff, 1);
+                    free(dhbuf);
+                    free(scratch);
+                    _mrs_source_release(mrs, src);
+                    return scratch ? MRSE_CANNOT_OPEN : MRSE_INSUFFICIENT_MEM;
+                }
+                decrypt.local_hdr(scratch, f.lh.h.extra_length);
+                f.lh.extra = _mrs_ref_table_append(&mrs->_reftable, scratch, f.lh.h.extra_length);
+                dbgprintf("Read local header extra: got address %p", f.lh.extra);
+            }
 
-        if (f.lh.h.extra_length) {
-            dbgprintf("We have Local extra, let's copy it");
-            f.lh.extra = (char*)malloc(f.lh.h.extra_length);
-            fread(f.lh.extra, f.lh.h.extra_length, 1, fp);
-            decrypt.local_hdr(f.lh.extra, f.lh.h.extra_length);
-            temp2 = f.lh.extra;
-            f.lh.extra = _mrs_ref_table_append(&mrs->_reftable, temp2, f.lh.h.extra_length);
-            free(temp2);
-            dbgprintf("Read local header extra: got address %p", f.lh.extra);
+            // We update our offset to the beginning of the file buffer
+            f.dh.h.offset = lhoff + sizeof(struct mrs_local_hdr_t) + f.lh.h.filename_length + f.lh.h.extra_length;
         }
-        else
-            fseek(fp, f.lh.h.extra_length, SEEK_CUR);
-
-        // We update our offset to the beginning of the file buffer
-        f.dh.h.offset = ftell(fp);
 
         temp += sizeof(struct mrs_central_dir_hdr_t);
 
         //// Reading filename
-        if (base_name) {
-            f.dh.filename = (char*)malloc(strlen(base_name) + f.dh.h.filename_length + 2);
-            memset(f.dh.filename, 0, strlen(base_name) + f.dh.h.filename_length + 2);
-            sprintf(f.dh.filename, "%s/", base_name);
-        }
-        else {
-            f.dh.filename = (char*)malloc(f.dh.h.filename_length + 1);
-            memset(f.dh.filename, 0, f.dh.h.filename_length + 1);
+        f.dh.filename = _mrs_pool_alloc(&mrs->_pool, base_len + f.dh.h.filename_length + 1);
+        if (!f.dh.filename) {
+            _mrs_replace_index_list_free(&ridxl);
+            _mrs_files_destroy(&ff, 1);
+            free(dhbuf);
+            free(scratch);
+            _mrs_source_release(mrs, src);
+            return MRSE_INSUFFICIENT_MEM;
         }
+        f.flags |= MRSFF_NAME_POOLED;
+        if (base_name)
+            sprintf(f.dh.filename, "%s/", base_name);
+        else
+            f.dh.filename[0] = 0;
         strncat(f.dh.filename, temp, f.dh.h.filename_length);
 
         // Check duplicate
@@ -686,8 +852,9 @@ int _mrs_add_mrs(MRS* mrs, const char* mrsname, char* base_name, void* reserved,
                     _mrs_replace_index_list_add(&ridxl, dup_index, i);
                     break;
                 case MRSDB_KEEP_BOTH:
-                    free(f.dh.filename);
+                    // The pooled name is just left unused
                     f.dh.filename = temp2;
+                    f.flags &= ~MRSFF_NAME_POOLED;
                     break;
                 case MRSDB_KEEP_OLD:
                     dbgprintf("Duplicate found!");
@@ -695,8 +862,9 @@ int _mrs_add_mrs(MRS* mrs, const char* mrsname, char* base_name, void* reserved,
                     _mrs_files_destroy(&ff, 1);
                     _mrs_file_free(&f);
                     free(dhbuf);
+                    free(scratch);
                     free(temp2);
-                    fclose(fp);
+                    _mrs_source_release(mrs, src);
                     return MRSE_DUPLICATE;
                 }
             }
@@ -719,43 +887,87 @@ int _mrs_add_mrs(MRS* mrs, const char* mrsname, char* base_name, void* reserved,
         }
         temp += f.dh.h.comment_length;
 
-        ///TODO: Check if compressed file buffer is valid
+        // The file buffer has to be in the archive (before its local header is read, its offset is that of the header),
+        // and a stored one is as big as the file, readers count on it
+        if ((unsigned long long)f.dh.h.offset + f.dh.h.compressed_size > mrs->_srcs.srcs[src - 1].size
+            || (f.dh.h.compression == MRSCM_STORE && f.dh.h.compressed_size != f.dh.h.uncompressed_size)) {
+            dbgprintf("File buffer @ %08x is out of the archive or not the size of the file", f.dh.h.offset);
+            _mrs_replace_index_list_free(&ridxl);
+            _mrs_files_destroy(&ff, 1);
+            _mrs_file_free(&f);
+            free(dhbuf);
+            free(scratch);
+            _mrs_source_release(mrs, src);
+            return MRSE_INVALID_MRS;
+        }
 
-        _mrs_files_append(&ff, &f);
+        if (!_mrs_files_append(&ff, &f)) {
+            _mrs_replace_index_list_free(&ridxl);
+            _mrs_files_destroy(&ff, 1);
+            _mrs_file_free(&f);
+            free(dhbuf);
+            free(scratch);
+            _mrs_source_release(mrs, src);
+            return MRSE_INSUFFICIENT_MEM;
+        }
     }
 
     free(dhbuf);
+    free(scratch);
+
+    // Every file buffer is copied before any file is added, so nothing is if one of them can't be
+    if (!(mrs->_flags & (MRSF_LAZY | MRSF_MMAP))) {
+        for (i = 0; i < ff.count; i++) {
+            e = _mrs_add_copy_buffer(mrs, src, &ff.files[i], decrypt.buffer);
+            if (e != MRSE_OK) {
+                while (i--)
+                    _mrs_temp_release(mrs, &ff.files[i]);
+                _mrs_replace_index_list_free(&ridxl);
+                _mrs_files_destroy(&ff, 1);
+                _mrs_source_release(mrs, src);
+                return e;
+            }
+        }
+    }
 
     for (i = 0; i < ff.count; i++) {
         dbgprintf("File %u is at offset %08x", i, ff.files[i].dh.h.offset);
-        temp = (char*)malloc(ff.files[i].dh.h.compressed_size);
-        fseek(fp, ff.files[i].dh.h.offset, SEEK_SET);
-        fread(temp, ff.files[i].dh.h.compressed_size, 1, fp);
-        // Decrypt the file buffer, if there's a decryption routine for it
-        if (decrypt.buffer)
-            decrypt.buffer(temp, ff.files[i].dh.h.compressed_size);
-        // We finally update our offset to the real offset in our temporary storage
-        ff.files[i].dh.h.offset = _mrs_temp_tell(mrs);
-        _mrs_temp_write(mrs, temp, ff.files[i].dh.h.compressed_size);
+        if (mrs->_flags & (MRSF_LAZY | MRSF_MMAP)) {
+            // The file buffer stays in the archive, it will be read from there when needed
+            ff.files[i].src = src;
+            _mrs_source_ref(mrs, src);
+        }
         _strslash(ff.files[i].dh.filename, 0);
         ff.files[i].dh.h.filename_length = strlen(ff.files[i].dh.filename);
         ff.files[i].lh.h.filename_length = ff.files[i].dh.h.filename_length;
 
-        free(temp);
         if (on_dupe == MRSDB_KEEP_NEW && ridxl.cnt) {
             if (!_mrs_replace_index_list_do_replace(&ridxl, mrs, ff.files, ff.count, i))
                 continue;
         }
+        // Room for all of them was reserved up front, so this can't fail
         _mrs_push_file(mrs, ff.files[i]);
     }
 
-    fclose(fp);
+    // Files read lazily hold their own reference, so this only closes the archive if none of them are left
+    _mrs_source_release(mrs, src);
     _mrs_replace_index_list_free(&ridxl);
     _mrs_files_destroy(&ff, 0);
 
     return MRSE_OK;
 }
 
+int _mrs_add_mrs(MRS* mrs, const char* mrsname, char* base_name, void* reserved, enum mrs_dupe_behavior_t on_dupe) {
+    return _mrs_add_mrs_source(mrs, mrsname, NULL, 0, base_name, reserved, on_dupe);
+}
+
+int _mrs_add_mrs_memory(MRS* mrs, const void* buffer, size_t size, char* base_name, void* reserved, enum mrs_dupe_behavior_t on_dupe) {
+    if (!buffer)
+        return MRSE_INVALID_PARAM;
+
+    return _mrs_add_mrs_source(mrs, NULL, (const unsigned char*)buffer, size, base_name, reserved, on_dupe);
+}
+
 /***************
 OLD _mrs_add_mrs FUNCTION
 
@@ -929,6 +1141,8 @@ int _mrs_add_mrs2(MRS* mrs, MRS* in, char* base_name, void* reserved, enum mrs_d
     int dup;
     unsigned dup_index;
     char* temp;
+    unsigned char* buf;
+    int e;
     struct mrs_replace_index_list_t il;
 
     _mrs_replace_index_list_init(&il);
@@ -945,23 +1159,41 @@ int _mrs_add_mrs2(MRS* mrs, MRS* in, char* base_name, void* reserved, enum mrs_d
         return MRSE_EMPTY;
 
     _mrs_files_init(&ff);
+    if(!_mrs_files_reserve(&ff, cnt) || !_mrs_reserve_files(mrs, mrs->_hdr.dir_count + cnt)){
+        _mrs_files_destroy(&ff, 0);
+        _mrs_replace_index_list_free(&il);
+        return MRSE_INSUFFICIENT_MEM;
+    }
     for(i=0; i<cnt; i++){
         memset(&f, 0, sizeof(struct mrs_file_t));
         dbgprintf("Adding file %u...", i);
         dbgprintf("  Filename:  %s", in->_files[i].dh.filename);
         dbgprintf("  File size: %u", in->_files[i].dh.h.compressed_size);
+        // Its local header extra has to be known before it's copied
+        if(!_mrs_file_resolve(in, &in->_files[i])){
+            _mrs_files_destroy(&ff, 1);
+            _mrs_replace_index_list_free(&il);
+            return MRSE_INVALID_ENCRYPTION;
+        }
         memcpy(&f, &in->_files[i], sizeof(struct mrs_file_t));
+        f.zidx = NULL;
         if(in->_files[i].dh.extra)
             f.dh.extra = _mrs_ref_table_append(&mrs->_reftable, in->_files[i].dh.extra, in->_files[i].dh.h.extra_length);
         if(in->_files[i].dh.comment)
             f.dh.comment = _mrs_ref_table_append(&mrs->_reftable, in->_files[i].dh.comment, in->_files[i].dh.h.comment_length);
         if(in->_files[i].lh.extra)
             f.lh.extra = _mrs_ref_table_append(&mrs->_reftable, in->_files[i].lh.extra, in->_files[i].lh.h.extra_length);
-        if(base_name){
-            f.dh.filename = (char*)malloc(strlen(base_name)+strlen(in->_files[i].dh.filename)+2);
+        f.dh.filename = _mrs_pool_alloc(&mrs->_pool, (base_name ? strlen(base_name)+1 : 0)+strlen(in->_files[i].dh.filename)+1);
+        if(!f.dh.filename){
+            _mrs_files_destroy(&ff, 1);
+            _mrs_replace_index_list_free(&il);
+            return MRSE_INSUFFICIENT_MEM;
+        }
+        f.flags = MRSFF_NAME_POOLED;
+        if(base_name)
             sprintf(f.dh.filename, "%s/%s", base_name, in->_files[i].dh.filename);
-        }else
-            f.dh.filename = strdup(in->_files[i].dh.filename);
+        else
+            strcpy(f.dh.filename, in->_files[i].dh.filename);
         dbgprintf("  Final name: %s", f.dh.filename);
 
         if (mrs->_hdr.dir_count) {
@@ -980,8 +1212,8 @@ int _mrs_add_mrs2(MRS* mrs, MRS* in, char* base_name, void* reserved, enum mrs_d
                     free(temp);
                     return MRSE_DUPLICATE;
                 case MRSDB_KEEP_BOTH:
-                    free(f.dh.filename);
                     f.dh.filename = temp;
+                    f.flags = 0;
                     break;
                 }
             }
@@ -991,21 +1223,42 @@ int _mrs_add_mrs2(MRS* mrs, MRS* in, char* base_name, void* reserved, enum mrs_d
         f.lh.filename = f.dh.filename;
         f.lh.h.filename_length = f.dh.h.filename_length;
 
-        _mrs_files_append(&ff, &f);
+        if(!_mrs_files_append(&ff, &f)){
+            _mrs_files_destroy(&ff, 1);
+            _mrs_file_free(&f);
+            _mrs_replace_index_list_free(&il);
+            return MRSE_INSUFFICIENT_MEM;
+        }
+    }
+
+    // Every file buffer is copied before any file is added, so nothing is if one of them can't be
+    for(i=0; i<cnt; i++){
+        buf = (unsigned char*)malloc(ff.files[i].dh.h.compressed_size ? ff.files[i].dh.h.compressed_size : 1);
+        e   = !buf ? MRSE_INSUFFICIENT_MEM : !_mrs_file_read(in, &ff.files[i], buf) ? MRSE_CANNOT_OPEN : MRSE_OK;
+        if(e == MRSE_OK){
+            ff.files[i].src = 0;
+            ff.files[i].dh.h.offset = _mrs_temp_tell(mrs);
+            if(!_mrs_temp_write(mrs, buf, ff.files[i].dh.h.compressed_size))
+                e = MRSE_INSUFFICIENT_MEM;
+        }
+        free(buf);
+        if(e != MRSE_OK){
+            while(i--)
+                _mrs_temp_release(mrs, &ff.files[i]);
+            _mrs_files_destroy(&ff, 1);
+            _mrs_replace_index_list_free(&il);
+            return e;
+        }
     }
 
     for(i=0; i<cnt; i++){
-        temp = (char*)malloc(ff.files[i].dh.h.compressed_size);
-        _mrs_temp_read(in, temp, ff.files[i].dh.h.offset, ff.files[i].dh.h.compressed_size);
-        ff.files[i].dh.h.offset = _mrs_temp_tell(mrs);
-        _mrs_temp_write(mrs, temp, ff.files[i].dh.h.compressed_size);
-        free(temp);
         if(on_dupe == MRSDB_KEEP_NEW && il.cnt){
             dbgprintf("Searching replace indices...");
             _mrs_replace_index_list_dump(&il);
             if(!_mrs_replace_index_list_do_replace(&il, mrs, ff.files, cnt, i))
                 continue;
         }
+        // Room for all of them was reserved up front, so this can't fail
         _mrs_push_file(mrs, ff.files[i]);
     }
     
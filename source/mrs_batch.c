@@ -0,0 +1,195 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mrs.h"
+#include "mrs_error.h"
+
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+       /// FROM mrs_util.c
+extern int _mrs_is_initialized(const MRS* mrs);
+       /// FROM mrs_util.c
+extern int _mrs_temp_read(const MRS* mrs, unsigned char* buf, off_t offset, size_t size);
+       /// FROM mrs_util.c
+extern const unsigned char* _mrs_file_ptr(const MRS* mrs, struct mrs_file_t* f);
+       /// FROM mrs_source.c
+extern int _mrs_source_read(const MRS* mrs, unsigned src, unsigned char* buf, off_t offset, size_t size);
+       /// FROM mrs_source.c
+extern int _mrs_file_resolve(const MRS* mrs, struct mrs_file_t* f);
+       /// FROM mrs_cache.c
+extern int _mrs_cache_get(const MRS* mrs, const struct mrs_file_t* f, unsigned char* buf);
+       /// FROM mrs_cache.c
+extern int _mrs_cache_put(const MRS* mrs, const struct mrs_file_t* f, const unsigned char* buf, size_t size, int pinned);
+       /// FROM mrs_compress.c
+extern int _mrs_inflate(const MRS* mrs, const unsigned char* in, size_t in_size, unsigned char* out, size_t out_size);
+
+static int _mrs_batch_cmp(const void* a, const void* b){
+    const struct mrs_batch_item_t* x = (const struct mrs_batch_item_t*)a;
+    const struct mrs_batch_item_t* y = (const struct mrs_batch_item_t*)b;
+
+    if(x->src != y->src)
+        return x->src < y->src ? -1 : 1;
+    if(x->offset != y->offset)
+        return x->offset < y->offset ? -1 : 1;
+    return 0;
+}
+
+/**< Makes sure `*buf` has at least `size` bytes. */
+static int _mrs_batch_reserve(unsigned char** buf, size_t* cap, size_t size){
+    unsigned char* p;
+
+    if(size <= *cap)
+        return 1;
+
+    p = (unsigned char*)realloc(*buf, size);
+    if(!p)
+        return 0;
+
+    *buf = p;
+    *cap = size;
+
+    return 1;
+}
+
+/**< Gives the (decrypted) compressed buffer `data` of `f` to `sink`, inflating it if needed. */
+static int _mrs_batch_deliver(const MRS* mrs, const struct mrs_file_t* f, unsigned index, const unsigned char* data,
+                              unsigned char** out, size_t* out_cap, MRS_READ_FUNC sink, void* param, int* stop)
+{
+    const unsigned char* res = data;
+
+    // Only `compressed_size` bytes of `data` are there, a stored file has to be all of them
+    if(f->dh.h.compression == MRSCM_STORE && f->dh.h.compressed_size != f->dh.h.uncompressed_size)
+        return MRSE_INVALID_MRS;
+
+    if(f->dh.h.compression != MRSCM_STORE){
+        if(!_mrs_batch_reserve(out, out_cap, f->dh.h.uncompressed_size))
+            return MRSE_INSUFFICIENT_MEM;
+        if(_mrs_inflate(mrs, data, f->dh.h.compressed_size, *out, f->dh.h.uncompressed_size))
+            return MRSE_CANNOT_UNCOMPRESS;
+        res = *out;
+    }
+
+    _mrs_cache_put(mrs, f, res, f->dh.h.uncompressed_size, 0);
+
+    *stop = sink(index, res, f->dh.h.uncompressed_size, param);
+
+    return MRSE_OK;
+}
+
+int mrs_read_many(const MRS* mrs, const unsigned* indices, size_t count, MRS_READ_FUNC sink, void* param){
+    struct mrs_batch_item_t* items;
+    struct mrs_file_t*       f;
+    const unsigned char*     ptr;
+    MRS_ENCRYPTION_FUNC      dec;
+    unsigned char* gbuf = NULL;
+    unsigned char* out  = NULL;
+    size_t gcap = 0, ocap = 0;
+    size_t i, j, n, g, start, end, mark, from;
+    int    r = MRSE_OK, stop = 0;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if((!indices && count) || !sink)
+        return MRSE_INVALID_PARAM;
+
+    for(i=0; i<count; i++){
+        if(indices[i] >= mrs->_hdr.dir_count)
+            return MRSE_INVALID_INDEX;
+    }
+
+    items = (struct mrs_batch_item_t*)malloc(sizeof(struct mrs_batch_item_t) * (count ? count : 1));
+    if(!items)
+        return MRSE_INSUFFICIENT_MEM;
+
+    // Whatever is cached goes first, the rest is read in order of where it is stored
+    for(i=0, n=0; i<count && !stop; i++){
+        f = &mrs->_files[indices[i]];
+        if(!_mrs_file_resolve(mrs, f)){
+            r = MRSE_INVALID_ENCRYPTION;
+            break;
+        }
+        if(mrs->_cache && _mrs_batch_reserve(&out, &ocap, f->dh.h.uncompressed_size) && _mrs_cache_get(mrs, f, out)){
+            stop = sink(indices[i], out, f->dh.h.uncompressed_size, param);
+            continue;
+        }
+        items[n].index  = indices[i];
+        items[n].src    = f->src;
+        items[n].offset = f->dh.h.offset;
+        items[n].csize  = f->dh.h.compressed_size;
+        n++;
+    }
+
+    if(r == MRSE_OK)
+        qsort(items, n, sizeof(struct mrs_batch_item_t), _mrs_batch_cmp);
+    else
+        n = 0;
+
+    for(i=0; i<n && !stop && r == MRSE_OK; i=j){
+        // Files next to each other (but for their local headers) are read in one go
+        start = items[i].offset;
+        end   = items[i].offset + items[i].csize;
+        for(j=i+1; j<n; j++){
+            if(items[j].src != items[i].src || items[j].offset > end + MRS_BATCH_GAP)
+                break;
+            if(items[j].offset + items[j].csize > end){
+                if(items[j].offset + items[j].csize - start > MRS_BATCH_MAX)
+                    break;
+                end = items[j].offset + items[j].csize;
+            }
+        }
+
+        // Mapped without decryption, nothing to read then
+        ptr = items[i].src ? _mrs_file_ptr(mrs, &mrs->_files[items[i].index]) : NULL;
+        if(ptr){
+            for(g=i; g<j && !stop && r == MRSE_OK; g++){
+                f   = &mrs->_files[items[g].index];
+                // Checked again for each one, it may not be in the mapping after all
+                ptr = _mrs_file_ptr(mrs, f);
+                r   = ptr ? _mrs_batch_deliver(mrs, f, items[g].index, ptr, &out, &ocap, sink, param, &stop) : MRSE_CANNOT_OPEN;
+            }
+            continue;
+        }
+
+        dbgprintf("Reading files %u to %u of the batch at once (%u bytes)", i, j-1, end - start);
+
+        if(!_mrs_batch_reserve(&gbuf, &gcap, end - start)){
+            r = MRSE_INSUFFICIENT_MEM;
+            break;
+        }
+
+        if(!(items[i].src ? _mrs_source_read(mrs, items[i].src, gbuf, start, end - start) : _mrs_temp_read(mrs, gbuf, start, end - start))){
+            r = MRSE_CANNOT_OPEN;
+            break;
+        }
+
+        dec  = items[i].src ? mrs->_srcs.srcs[items[i].src-1].dec : NULL;
+        mark = start;
+        for(g=i; g<j && !stop && r == MRSE_OK; g++){
+            f = &mrs->_files[items[g].index];
+            // Only the files themselves are decrypted, and only once if the same file was asked for twice
+            if(dec && items[g].offset + items[g].csize > mark){
+                from = items[g].offset > mark ? items[g].offset : mark;
+                dec(gbuf + (from - start), items[g].offset + items[g].csize - from);
+                mark = items[g].offset + items[g].csize;
+            }
+            r = _mrs_batch_deliver(mrs, f, items[g].index, gbuf + (items[g].offset - start), &out, &ocap, sink, param, &stop);
+        }
+    }
+
+    free(items);
+    free(gbuf);
+    free(out);
+
+    return r;
+}
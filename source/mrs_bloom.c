@@ -0,0 +1,245 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mrs.h"
+#include "mrs_error.h"
+
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+       /// FROM mrs_util.c
+extern int _mrs_is_initialized(const MRS* mrs);
+       /// FROM mrs_index.c
+extern uint32_t _mrs_name_hash(const char* s);
+
+/**< Spreads the bits of the name hash `h`, the filter needs more than what the hash itself mixes. */
+static uint64_t _mrs_bloom_mix(uint32_t h){
+    uint64_t x = h;
+
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+
+    return x;
+}
+
+/**< First bit of the block of `h` in `b`, and where (`bit`) and how far apart (`step`) its bits are in it. */
+static uint64_t* _mrs_bloom_block(const struct mrs_bloom_t* b, uint32_t h, unsigned* bit, unsigned* step){
+    uint64_t x = _mrs_bloom_mix(h);
+
+    *bit  = (unsigned)(x & (MRS_BLOOM_BLOCK - 1));
+    *step = (unsigned)((x >> 9) & (MRS_BLOOM_BLOCK - 1)) | 1;
+
+    return b->bits + (size_t)((x >> 32) % b->nblocks) * (MRS_BLOOM_BLOCK / 64);
+}
+
+static void _mrs_bloom_set(struct mrs_bloom_t* b, uint32_t h){
+    uint64_t* blk;
+    unsigned  bit, step, j;
+
+    blk = _mrs_bloom_block(b, h, &bit, &step);
+    for(j=0; j<b->k; j++, bit = (bit + step) & (MRS_BLOOM_BLOCK - 1))
+        blk[bit >> 6] |= 1ULL << (bit & 63);
+}
+
+/**< `0` if the name of hash `h` is surely not in `b`. */
+int _mrs_bloom_test(const struct mrs_bloom_t* b, uint32_t h){
+    const uint64_t* blk;
+    unsigned        bit, step, j;
+
+    blk = _mrs_bloom_block(b, h, &bit, &step);
+    for(j=0; j<b->k; j++, bit = (bit + step) & (MRS_BLOOM_BLOCK - 1)){
+        if(!(blk[bit >> 6] & (1ULL << (bit & 63))))
+            return 0;
+    }
+
+    return 1;
+}
+
+/**< Sets the number of blocks of `b` for `n` names and allocates them, `0` if out of memory. */
+static int _mrs_bloom_alloc(struct mrs_bloom_t* b, size_t n){
+    free(b->bits);
+
+    b->cap     = n < 64 ? 64 : n;
+    b->nblocks = (b->cap * b->bits_per_name + MRS_BLOOM_BLOCK - 1) / MRS_BLOOM_BLOCK;
+    b->bits    = (uint64_t*)calloc(b->nblocks, MRS_BLOOM_BLOCK / 8);
+    if(!b->bits){
+        b->nblocks = 0;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**< Makes the filter of `mrs` again from all its files, with room for twice as many. */
+static int _mrs_bloom_build(MRS* mrs){
+    struct mrs_bloom_t* b = &mrs->_bloom;
+    unsigned i;
+
+    if(!_mrs_bloom_alloc(b, mrs->_hdr.dir_count * 2)){
+        dbgprintf("No memory for the name filter, names will go straight to the index");
+        return 0;
+    }
+
+    for(i=0; i<mrs->_hdr.dir_count; i++)
+        _mrs_bloom_set(b, _mrs_name_hash(mrs->_files[i].dh.filename));
+    b->names = mrs->_hdr.dir_count;
+
+    dbgprintf("Name filter: %u block(s) for %u name(s), %u bit(s) each", b->nblocks, b->names, b->k);
+
+    return 1;
+}
+
+/**< Counts in the name of hash `h`, which was just added to `mrs`. */
+void _mrs_bloom_add(MRS* mrs, uint32_t h){
+    struct mrs_bloom_t* b = &mrs->_bloom;
+
+    b->sum += _mrs_bloom_mix(h);
+
+    if(!b->bits)
+        return;
+
+    // Past what it was made for, false positives go up fast
+    if(++b->names > b->cap){
+        _mrs_bloom_build(mrs);
+        return;
+    }
+
+    _mrs_bloom_set(b, h);
+}
+
+/**< Counts out the name of hash `h`, which is being taken out of `mrs`. Its bits stay set, they might be someone else's. */
+void _mrs_bloom_remove(MRS* mrs, uint32_t h){
+    mrs->_bloom.sum -= _mrs_bloom_mix(h);
+}
+
+void _mrs_bloom_free(MRS* mrs){
+    free(mrs->_bloom.bits);
+    mrs->_bloom.bits    = NULL;
+    mrs->_bloom.nblocks = 0;
+}
+
+int mrs_set_name_filter(MRS* mrs, unsigned bits_per_name){
+    struct mrs_bloom_t* b;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(bits_per_name > 64)
+        return MRSE_INVALID_PARAM;
+
+    b = &mrs->_bloom;
+    _mrs_bloom_free(mrs);
+    if(!bits_per_name)
+        return MRSE_OK;
+
+    // Bits per name times ln(2) is the best number of bits to set per name
+    b->bits_per_name = bits_per_name;
+    b->k = (bits_per_name * 69 + 50) / 100;
+    if(!b->k)
+        b->k = 1;
+
+    return _mrs_bloom_build(mrs) ? MRSE_OK : MRSE_INSUFFICIENT_MEM;
+}
+
+int mrs_save_name_filter(const MRS* mrs, const char* filename){
+    const struct mrs_bloom_t* b;
+    struct mrs_bloom_hdr_t    hdr;
+    FILE* f;
+    int   ok;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    b = &mrs->_bloom;
+    if(!filename || !b->bits)
+        return MRSE_INVALID_PARAM;
+
+    hdr.magic         = MRS_BLOOM_MAGIC;
+    hdr.version       = MRS_BLOOM_VERSION;
+    hdr.k             = b->k;
+    hdr.bits_per_name = b->bits_per_name;
+    hdr.names         = mrs->_hdr.dir_count;
+    hdr.sum           = b->sum;
+    hdr.nblocks       = b->nblocks;
+
+    f = fopen(filename, "wb");
+    if(!f)
+        return MRSE_CANNOT_OPEN;
+
+    ok = fwrite(&hdr, sizeof(struct mrs_bloom_hdr_t), 1, f) == 1 && fwrite(b->bits, MRS_BLOOM_BLOCK / 8, b->nblocks, f) == b->nblocks;
+    if(fclose(f))
+        ok = 0;
+
+    dbgprintf("Saved name filter to \"%s\": %s", filename, ok ? "ok" : "failed");
+
+    return ok ? MRSE_OK : MRSE_CANNOT_SAVE;
+}
+
+int mrs_load_name_filter(MRS* mrs, const char* filename){
+    struct mrs_bloom_t     b;
+    struct mrs_bloom_hdr_t hdr;
+    FILE* f;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(!filename)
+        return MRSE_INVALID_PARAM;
+
+    f = fopen(filename, "rb");
+    if(!f)
+        return MRSE_NOT_FOUND;
+
+    if(fread(&hdr, sizeof(struct mrs_bloom_hdr_t), 1, f) != 1 || hdr.magic != MRS_BLOOM_MAGIC || hdr.version != MRS_BLOOM_VERSION
+       || !hdr.k || hdr.k > 64 || !hdr.bits_per_name || hdr.bits_per_name > 64 || !hdr.nblocks || hdr.nblocks > ((size_t)-1) / MRS_BLOOM_BLOCK){
+        fclose(f);
+        return MRSE_INVALID_PARAM;
+    }
+
+    // Saved for other names: the sum of their hashes rules that out without going through the names
+    if(hdr.names != mrs->_hdr.dir_count || hdr.sum != mrs->_bloom.sum){
+        dbgprintf("Name filter \"%s\" is for %u other name(s)", filename, (unsigned)hdr.names);
+        fclose(f);
+        return MRSE_OUTDATED;
+    }
+
+    memset(&b, 0, sizeof(struct mrs_bloom_t));
+    b.k             = hdr.k;
+    b.bits_per_name = hdr.bits_per_name;
+    b.nblocks       = (size_t)hdr.nblocks;
+    b.bits          = (uint64_t*)malloc(b.nblocks * (MRS_BLOOM_BLOCK / 8));
+    if(!b.bits){
+        fclose(f);
+        return MRSE_INSUFFICIENT_MEM;
+    }
+    if(fread(b.bits, MRS_BLOOM_BLOCK / 8, b.nblocks, f) != b.nblocks){
+        free(b.bits);
+        fclose(f);
+        return MRSE_INVALID_PARAM;
+    }
+    fclose(f);
+
+    // Room for as many more names as it had before getting made again
+    b.names = mrs->_hdr.dir_count;
+    b.cap   = b.nblocks * MRS_BLOOM_BLOCK / b.bits_per_name;
+    b.sum   = mrs->_bloom.sum;
+
+    _mrs_bloom_free(mrs);
+    mrs->_bloom = b;
+
+    dbgprintf("Loaded name filter from \"%s\": %u block(s)", filename, b.nblocks);
+
+    return MRSE_OK;
+}
@@ -0,0 +1,406 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mrs.h"
+#include "mrs_error.h"
+
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+       /// FROM mrs_util.c
+extern int _mrs_is_initialized(const MRS* mrs);
+       /// FROM mrs_util.c
+extern void _mrs_lock(const MRS* mrs);
+       /// FROM mrs_util.c
+extern void _mrs_unlock(const MRS* mrs);
+
+static size_t _mrs_cache_bucket(const struct mrs_cache_t* c, unsigned src, uint32_t offset, uint32_t csize){
+    uint32_t h;
+
+    h  = src * 0x9e3779b1u ^ offset * 0x85ebca6bu ^ csize * 0xc2b2ae35u;
+    h ^= h >> 16;
+
+    return h & (c->nbuckets - 1);
+}
+
+/**< Item holding the contents of `f`, or `NULL` if it isn't cached. */
+static struct mrs_cache_item_t* _mrs_cache_find(const struct mrs_cache_t* c, const struct mrs_file_t* f){
+    struct mrs_cache_item_t* it;
+
+    if(!c->nbuckets)
+        return NULL;
+
+    for(it=c->buckets[_mrs_cache_bucket(c, f->src, f->dh.h.offset, f->dh.h.compressed_size)]; it; it=it->next){
+        if(it->src == f->src && it->offset == f->dh.h.offset && it->csize == f->dh.h.compressed_size)
+            return it;
+    }
+
+    return NULL;
+}
+
+static void _mrs_cache_lru_unlink(struct mrs_cache_t* c, struct mrs_cache_item_t* it){
+    if(it->lru_prev)
+        it->lru_prev->lru_next = it->lru_next;
+    else
+        c->lru_head = it->lru_next;
+    if(it->lru_next)
+        it->lru_next->lru_prev = it->lru_prev;
+    else
+        c->lru_tail = it->lru_prev;
+    it->lru_prev = it->lru_next = NULL;
+}
+
+/**< Makes `it` the most recently used item. */
+static void _mrs_cache_lru_push(struct mrs_cache_t* c, struct mrs_cache_item_t* it){
+    it->lru_prev = NULL;
+    it->lru_next = c->lru_head;
+    if(c->lru_head)
+        c->lru_head->lru_prev = it;
+    else
+        c->lru_tail = it;
+    c->lru_head = it;
+}
+
+static void _mrs_cache_touch(struct mrs_cache_t* c, struct mrs_cache_item_t* it){
+    if(it->pinned || c->lru_head == it)
+        return;
+    _mrs_cache_lru_unlink(c, it);
+    _mrs_cache_lru_push(c, it);
+}
+
+static void _mrs_cache_link(struct mrs_cache_t* c, struct mrs_cache_item_t* it){
+    size_t b = _mrs_cache_bucket(c, it->src, it->offset, it->csize);
+
+    it->next      = c->buckets[b];
+    c->buckets[b] = it;
+}
+
+static void _mrs_cache_unlink(struct mrs_cache_t* c, struct mrs_cache_item_t* it){
+    struct mrs_cache_item_t** p = &c->buckets[_mrs_cache_bucket(c, it->src, it->offset, it->csize)];
+
+    while(*p != it)
+        p = &(*p)->next;
+    *p = it->next;
+}
+
+/**< Doubles the buckets once there are as many items, `0` if out of memory (the cache still works, just slower). */
+static int _mrs_cache_grow(struct mrs_cache_t* c){
+    struct mrs_cache_item_t** old = c->buckets;
+    struct mrs_cache_item_t*  it;
+    struct mrs_cache_item_t*  next;
+    size_t                    n = c->nbuckets, i;
+
+    if(n && c->count < n)
+        return 1;
+
+    c->buckets = (struct mrs_cache_item_t**)calloc(n ? n * 2 : MRS_CACHE_BUCKETS, sizeof(struct mrs_cache_item_t*));
+    if(!c->buckets){
+        c->buckets = old;
+        return n != 0;
+    }
+    c->nbuckets = n ? n * 2 : MRS_CACHE_BUCKETS;
+
+    for(i=0; i<n; i++){
+        for(it=old[i]; it; it=next){
+            next = it->next;
+            _mrs_cache_link(c, it);
+        }
+    }
+    free(old);
+
+    return 1;
+}
+
+static void _mrs_cache_remove(struct mrs_cache_t* c, struct mrs_cache_item_t* it){
+    _mrs_cache_unlink(c, it);
+    if(!it->pinned)
+        _mrs_cache_lru_unlink(c, it);
+    c->used -= it->size;
+    c->count--;
+    free(it->buf);
+    free(it);
+}
+
+/**< Evicts the least recently used items (that aren't pinned) until `need` more bytes fit in the budget. */
+static void _mrs_cache_evict(struct mrs_cache_t* c, size_t need){
+    while(c->used + need > c->budget && c->lru_tail){
+        dbgprintf("Evicting %u bytes from the cache", c->lru_tail->size);
+        _mrs_cache_remove(c, c->lru_tail);
+        c->stats_evictions++;
+    }
+}
+
+/**< Copies the cached contents of `f` to `buf`, returns `0` (and counts a miss) if they aren't cached. */
+int _mrs_cache_get(const MRS* mrs, const struct mrs_file_t* f, unsigned char* buf){
+    struct mrs_cache_t*      c = mrs->_cache;
+    struct mrs_cache_item_t* it;
+
+    if(!c)
+        return 0;
+
+    _mrs_lock(mrs);
+
+    it = _mrs_cache_find(c, f);
+    if(!it){
+        c->stats_misses++;
+        _mrs_unlock(mrs);
+        return 0;
+    }
+
+    memcpy(buf, it->buf, it->size);
+    _mrs_cache_touch(c, it);
+    c->stats_hits++;
+
+    _mrs_unlock(mrs);
+
+    return 1;
+}
+
+/**< Pins `it`, or lets it be evicted again. */
+static void _mrs_cache_pin_item(struct mrs_cache_t* c, struct mrs_cache_item_t* it, int pinned){
+    if(!it->pinned == !pinned)
+        return;
+    if(pinned)
+        _mrs_cache_lru_unlink(c, it);
+    else
+        _mrs_cache_lru_push(c, it);
+    it->pinned = pinned;
+}
+
+/**< Keeps a copy of the contents of `f`, if they fit in the budget (or `pinned` is set). */
+static int _mrs_cache_put_locked(const MRS* mrs, const struct mrs_file_t* f, const unsigned char* buf, size_t size, int pinned){
+    struct mrs_cache_t*      c = mrs->_cache;
+    struct mrs_cache_item_t* it;
+
+    if(!c)
+        return 0;
+
+    it = _mrs_cache_find(c, f);
+    if(it){
+        if(pinned)
+            _mrs_cache_pin_item(c, it, 1);
+        _mrs_cache_touch(c, it);
+        return 1;
+    }
+
+    if(size > c->budget && !pinned)
+        return 0;
+
+    _mrs_cache_evict(c, size);
+    if(c->used + size > c->budget && !pinned)
+        return 0;
+
+    if(!_mrs_cache_grow(c))
+        return 0;
+
+    it = (struct mrs_cache_item_t*)calloc(1, sizeof(struct mrs_cache_item_t));
+    if(!it)
+        return 0;
+    it->buf = (unsigned char*)malloc(size ? size : 1);
+    if(!it->buf){
+        free(it);
+        return 0;
+    }
+    memcpy(it->buf, buf, size);
+    it->size   = size;
+    it->src    = f->src;
+    it->offset = f->dh.h.offset;
+    it->csize  = f->dh.h.compressed_size;
+    it->pinned = pinned;
+
+    _mrs_cache_link(c, it);
+    if(!pinned)
+        _mrs_cache_lru_push(c, it);
+
+    c->count++;
+    c->used += size;
+
+    return 1;
+}
+
+int _mrs_cache_put(const MRS* mrs, const struct mrs_file_t* f, const unsigned char* buf, size_t size, int pinned){
+    int r;
+
+    if(!mrs->_cache)
+        return 0;
+
+    _mrs_lock(mrs);
+    r = _mrs_cache_put_locked(mrs, f, buf, size, pinned);
+    _mrs_unlock(mrs);
+
+    return r;
+}
+
+/**
+ * Forgets the contents of `f`, for when they change or go away.
+ * Like the other functions that change files, it isn't meant to run while `mrs` is read from other threads.
+ */
+void _mrs_cache_drop(MRS* mrs, const struct mrs_file_t* f){
+    struct mrs_cache_item_t* it;
+
+    if(!mrs->_cache)
+        return;
+
+    it = _mrs_cache_find(mrs->_cache, f);
+    if(it)
+        _mrs_cache_remove(mrs->_cache, it);
+}
+
+/**< Follows `f` to `offset`, where compacting the temporary storage moved its buffer, so it stays cached. */
+void _mrs_cache_move(MRS* mrs, const struct mrs_file_t* f, uint32_t offset){
+    struct mrs_cache_item_t* it;
+
+    if(!mrs->_cache)
+        return;
+
+    it = _mrs_cache_find(mrs->_cache, f);
+    if(!it)
+        return;
+
+    _mrs_cache_unlink(mrs->_cache, it);
+    it->offset = offset;
+    _mrs_cache_link(mrs->_cache, it);
+}
+
+/**< Forgets everything read from source `src`, for when it is closed (and its slot may be reused). */
+void _mrs_cache_drop_source(MRS* mrs, unsigned src){
+    struct mrs_cache_item_t* it;
+    struct mrs_cache_item_t* next;
+    size_t i;
+
+    if(!mrs->_cache)
+        return;
+
+    for(i=0; i<mrs->_cache->nbuckets; i++){
+        for(it=mrs->_cache->buckets[i]; it; it=next){
+            next = it->next;
+            if(it->src == src)
+                _mrs_cache_remove(mrs->_cache, it);
+        }
+    }
+}
+
+void _mrs_cache_free(MRS* mrs){
+    struct mrs_cache_item_t* it;
+    struct mrs_cache_item_t* next;
+    size_t i;
+
+    if(!mrs->_cache)
+        return;
+
+    for(i=0; i<mrs->_cache->nbuckets; i++){
+        for(it=mrs->_cache->buckets[i]; it; it=next){
+            next = it->next;
+            free(it->buf);
+            free(it);
+        }
+    }
+    free(mrs->_cache->buckets);
+    free(mrs->_cache);
+    mrs->_cache = NULL;
+}
+
+int mrs_set_cache(MRS* mrs, size_t budget){
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(!budget){
+        dbgprintf("Cache disabled");
+        _mrs_cache_free(mrs);
+        return MRSE_OK;
+    }
+
+    if(!mrs->_cache){
+        mrs->_cache = (struct mrs_cache_t*)calloc(1, sizeof(struct mrs_cache_t));
+        if(!mrs->_cache)
+            return MRSE_INSUFFICIENT_MEM;
+    }
+
+    dbgprintf("Cache budget set to %u bytes", budget);
+    _mrs_lock(mrs);
+    mrs->_cache->budget = budget;
+    _mrs_cache_evict(mrs->_cache, 0);
+    _mrs_unlock(mrs);
+
+    return MRSE_OK;
+}
+
+int mrs_cache_pin(MRS* mrs, unsigned index, int pin){
+    struct mrs_file_t*       f;
+    struct mrs_cache_item_t* it;
+    unsigned char*           buf;
+    int r;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(!mrs->_cache)
+        return MRSE_UNSUPPORTED;
+
+    if(index >= mrs->_hdr.dir_count)
+        return MRSE_INVALID_INDEX;
+
+    f = &mrs->_files[index];
+
+    _mrs_lock(mrs);
+    it = _mrs_cache_find(mrs->_cache, f);
+    if(!pin){
+        if(it){
+            _mrs_cache_pin_item(mrs->_cache, it, 0);
+            _mrs_cache_evict(mrs->_cache, 0);
+        }
+        _mrs_unlock(mrs);
+        return MRSE_OK;
+    }
+    if(it){
+        _mrs_cache_pin_item(mrs->_cache, it, 1);
+        _mrs_unlock(mrs);
+        return MRSE_OK;
+    }
+    _mrs_unlock(mrs);
+
+    buf = (unsigned char*)malloc(f->dh.h.uncompressed_size ? f->dh.h.uncompressed_size : 1);
+    if(!buf)
+        return MRSE_INSUFFICIENT_MEM;
+
+    // mrs_read caches it (as not pinned), so it only has to be pinned afterwards
+    r = mrs_read(mrs, index, buf, f->dh.h.uncompressed_size, NULL);
+    if(r == MRSE_OK && !_mrs_cache_put(mrs, f, buf, f->dh.h.uncompressed_size, 1))
+        r = MRSE_INSUFFICIENT_MEM;
+
+    free(buf);
+
+    return r;
+}
+
+int mrs_get_cache_stats(const MRS* mrs, struct mrs_cache_stats_t* stats){
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(!stats)
+        return MRSE_INVALID_PARAM;
+
+    memset(stats, 0, sizeof(struct mrs_cache_stats_t));
+    if(!mrs->_cache)
+        return MRSE_OK;
+
+    _mrs_lock(mrs);
+    stats->hits      = mrs->_cache->stats_hits;
+    stats->misses    = mrs->_cache->stats_misses;
+    stats->evictions = mrs->_cache->stats_evictions;
+    stats->count     = mrs->_cache->count;
+    stats->used      = mrs->_cache->used;
+    stats->budget    = mrs->_cache->budget;
+    _mrs_unlock(mrs);
+
+    return MRSE_OK;
+}
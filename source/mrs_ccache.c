@@ -0,0 +1,236 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <Shlwapi.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "mrs.h"
+#include "mrs_error.h"
+
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+       /// FROM mrs_util.c
+extern int _mrs_is_initialized(const MRS* mrs);
+       /// FROM utils.c
+extern int _mkdirs(const char* s);
+
+/**< FNV-1a hash (64 bits) of `buf`, together with its size and CRC32 it names a cache entry. */
+uint64_t _mrs_ccache_hash(const unsigned char* buf, size_t size){
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t   i;
+
+    for(i=0; i<size; i++){
+        h ^= buf[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+/**
+ * Path of the entry of a buffer of `size` bytes, `hash` and `crc32` compressed with `codec` as `c` says (and
+ * `predict`), `NULL` if out of memory. Entries are spread over 256 subdirectories, `dir` is set to the one of it.
+ */
+static char* _mrs_ccache_path(const MRS* mrs, uint64_t hash, uint32_t crc32, size_t size, const struct mrs_compression_t* c,
+                              int predict, const struct mrs_codec_t* codec, char** dir){
+    char   name[32];
+    char*  path;
+    size_t len, i;
+
+    // Backends make different bytes, so each one has its own entries
+    len = 0;
+    for(i=0; codec->name && codec->name[i] && len < sizeof(name) - 1; i++)
+        name[len++] = isalnum((unsigned char)codec->name[i]) ? codec->name[i] : '_';
+    name[len] = 0;
+
+    len  = strlen(mrs->_ccache) + strlen(name) + 80;
+    path = (char*)malloc(len);
+    *dir = (char*)malloc(len);
+    if(!path || !*dir){
+        free(path);
+        free(*dir);
+        return NULL;
+    }
+
+    sprintf(*dir, "%s/%02x", mrs->_ccache, (unsigned)(hash >> 56));
+    sprintf(path, "%s/%016llx%08x%016llx-%s-%d-%d%s", *dir, (unsigned long long)hash, crc32, (unsigned long long)size,
+            name, c->level, c->strategy, predict ? "-p" : "");
+
+    return path;
+}
+
+/**< Reads the entry at `path` into `p` (which has `size`, `crc32` set), `0` if there's none or it isn't for `p`. */
+static int _mrs_ccache_read(const char* path, uint64_t hash, struct mrs_packed_t* p){
+    struct mrs_ccache_hdr_t hdr;
+    FILE* f;
+
+    f = fopen(path, "rb");
+    if(!f)
+        return 0;
+
+    if(fread(&hdr, sizeof(struct mrs_ccache_hdr_t), 1, f) != 1 || hdr.magic != MRS_CCACHE_MAGIC || hdr.version != MRS_CCACHE_VERSION
+       || hdr.size != p->size || hdr.hash != hash || hdr.crc32 != p->crc32
+       || (hdr.compression != MRSCM_DEFLATE && hdr.compression != MRSCM_STORE)
+       || (hdr.compression == MRSCM_DEFLATE && (!hdr.csize || hdr.csize > p->size + 16))){
+        fclose(f);
+        return 0;
+    }
+
+    // Stored as is, the caller copies it
+    if(hdr.compression == MRSCM_STORE){
+        fclose(f);
+        p->compression = MRSCM_STORE;
+        return 1;
+    }
+
+    p->buf = (unsigned char*)malloc((size_t)hdr.csize);
+    if(!p->buf || fread(p->buf, 1, (size_t)hdr.csize, f) != hdr.csize
+       || crc32(crc32(0, Z_NULL, 0), (const Bytef*)p->buf, (uInt)hdr.csize) != hdr.ccrc32){
+        free(p->buf);
+        p->buf = NULL;
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+
+    p->csize       = (size_t)hdr.csize;
+    p->compression = MRSCM_DEFLATE;
+
+    return 1;
+}
+
+/**
+ * Looks up how the buffer of `p` (`size`, `crc32` set) of `hash` is compressed with `codec` as `c` says (and
+ * `predict`), `1` if it's cached: `p->compression` is set, and with `MRSCM_DEFLATE` so are `p->buf` and `p->csize`.
+ */
+int _mrs_ccache_get(const MRS* mrs, uint64_t hash, const struct mrs_compression_t* c, int predict, const struct mrs_codec_t* codec,
+                    struct mrs_packed_t* p){
+    char* path;
+    char* dir;
+    int   r;
+
+    path = _mrs_ccache_path(mrs, hash, p->crc32, p->size, c, predict, codec, &dir);
+    if(!path)
+        return 0;
+
+    r = _mrs_ccache_read(path, hash, p);
+    dbgprintf("%s: %s", path, r ? "hit" : "miss");
+
+    free(path);
+    free(dir);
+
+    return r;
+}
+
+/**
+ * Caches `p`, compressed from a buffer of `hash` with `codec` as `c` says (and `predict`). It's written to a
+ * temporary file first and then renamed, so other threads and processes sharing the cache never see half of it.
+ */
+void _mrs_ccache_put(const MRS* mrs, uint64_t hash, const struct mrs_compression_t* c, int predict, const struct mrs_codec_t* codec,
+                     const struct mrs_packed_t* p){
+    struct mrs_ccache_hdr_t hdr;
+    char*  path;
+    char*  dir;
+    char*  temp;
+    FILE*  f;
+    int    ok;
+
+    path = _mrs_ccache_path(mrs, hash, p->crc32, p->size, c, predict, codec, &dir);
+    if(!path)
+        return;
+
+    temp = (char*)malloc(strlen(path) + 40);
+    if(!temp){
+        free(path);
+        free(dir);
+        return;
+    }
+#ifdef _WIN32
+    sprintf(temp, "%s.%lx.%p", path, (unsigned long)GetCurrentProcessId(), (const void*)p);
+#else
+    sprintf(temp, "%s.%lx.%p", path, (unsigned long)getpid(), (const void*)p);
+#endif
+
+    memset(&hdr, 0, sizeof(struct mrs_ccache_hdr_t));
+    hdr.magic       = MRS_CCACHE_MAGIC;
+    hdr.version     = MRS_CCACHE_VERSION;
+    hdr.size        = p->size;
+    hdr.hash        = hash;
+    hdr.crc32       = p->crc32;
+    hdr.compression = p->compression;
+    hdr.csize       = p->compression == MRSCM_DEFLATE ? p->csize : 0;
+    hdr.ccrc32      = crc32(0, Z_NULL, 0);
+    if(hdr.csize)
+        hdr.ccrc32 = crc32(hdr.ccrc32, (const Bytef*)p->buf, (uInt)hdr.csize);
+
+    _mkdirs(dir);
+    f = fopen(temp, "wb");
+    if(f){
+        ok = fwrite(&hdr, sizeof(struct mrs_ccache_hdr_t), 1, f) == 1
+             && (!hdr.csize || fwrite(p->buf, 1, (size_t)hdr.csize, f) == hdr.csize);
+        if(fclose(f))
+            ok = 0;
+        // Someone else may have cached the same buffer in the meantime, theirs is just as good
+        if(!ok || rename(temp, path))
+            remove(temp);
+    }
+    dbgprintf("%s: %s", path, f ? "cached" : "can't write");
+
+    free(temp);
+    free(path);
+    free(dir);
+}
+
+int mrs_set_compression_cache(MRS* mrs, const char* dir){
+    char*  d;
+    size_t len;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(!dir){
+        free(mrs->_ccache);
+        mrs->_ccache = NULL;
+        return MRSE_OK;
+    }
+
+    len = strlen(dir);
+    while(len > 1 && (dir[len - 1] == '/' || dir[len - 1] == '\\'))
+        len--;
+    if(!len)
+        return MRSE_INVALID_PARAM;
+
+    d = (char*)malloc(len + 1);
+    if(!d)
+        return MRSE_INSUFFICIENT_MEM;
+    memcpy(d, dir, len);
+    d[len] = 0;
+
+    _mkdirs(d);
+    if(!PathIsDirectoryA(d)){
+        dbgprintf("\"%s\" is not a directory and can't be made one", d);
+        free(d);
+        return MRSE_CANNOT_OPEN;
+    }
+
+    dbgprintf("Compression cache at \"%s\"", d);
+    free(mrs->_ccache);
+    mrs->_ccache = d;
+
+    return MRSE_OK;
+}
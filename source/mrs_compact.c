@@ -0,0 +1,270 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mrs.h"
+#include "mrs_error.h"
+
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+       /// FROM mrs_util.c
+extern int _mrs_is_initialized(const MRS* mrs);
+       /// FROM mrs_util.c
+extern int _mrs_pread(FILE* fp, unsigned char* buf, off_t offset, size_t size);
+       /// FROM mrs_cache.c
+extern void _mrs_cache_move(MRS* mrs, const struct mrs_file_t* f, uint32_t offset);
+
+static int _mrs_compact_cmp(const void* a, const void* b){
+    const struct mrs_file_t* fa = *(const struct mrs_file_t* const*)a;
+    const struct mrs_file_t* fb = *(const struct mrs_file_t* const*)b;
+
+    if(fa->dh.h.offset != fb->dh.h.offset)
+        return fa->dh.h.offset < fb->dh.h.offset ? -1 : 1;
+    return 0;
+}
+
+/**< Files kept in the temporary storage in order of where their buffer is, `NULL` if out of memory. */
+static struct mrs_file_t** _mrs_compact_files(const MRS* mrs, size_t* count){
+    struct mrs_file_t** files;
+    size_t i, n = 0;
+
+    files = (struct mrs_file_t**)malloc(sizeof(struct mrs_file_t*) * (mrs->_hdr.dir_count ? mrs->_hdr.dir_count : 1));
+    if(!files)
+        return NULL;
+
+    for(i=0; i<mrs->_hdr.dir_count; i++){
+        if(!mrs->_files[i].src)
+            files[n++] = &mrs->_files[i];
+    }
+    qsort(files, n, sizeof(struct mrs_file_t*), _mrs_compact_cmp);
+
+    *count = n;
+
+    return files;
+}
+
+/**< Bytes of the temporary storage used by `files` (in order of offset), counting once those they share. */
+static size_t _mrs_compact_live(struct mrs_file_t* const* files, size_t n){
+    size_t i, off, end = 0, live = 0;
+
+    for(i=0; i<n; i++){
+        off = files[i]->dh.h.offset;
+        if(off < end)
+            off = end;
+        if(off < (size_t)files[i]->dh.h.offset + files[i]->dh.h.compressed_size){
+            end   = (size_t)files[i]->dh.h.offset + files[i]->dh.h.compressed_size;
+            live += end - off;
+        }
+    }
+
+    return live;
+}
+
+/**< Copies `size` bytes at `from` of the temporary file to `fp`, through `buf` (`MRS_COMPACT_STEP` bytes). */
+static int _mrs_compact_copy_file(const MRS* mrs, FILE* fp, unsigned char* buf, size_t from, size_t size){
+    size_t n;
+
+    while(size){
+        n = size < MRS_COMPACT_STEP ? size : MRS_COMPACT_STEP;
+        if(!_mrs_pread(mrs->_fbuf, buf, from, n) || fwrite(buf, n, 1, fp) != 1)
+            return 0;
+        from += n;
+        size -= n;
+    }
+
+    return 1;
+}
+
+/**
+ * Puts the buffers of `files` (in order of offset) next to each other, `offsets` receives where each one ends up and
+ * `size` the bytes they take. With a temporary file they are copied to `fp`, which is left as it was if it fails,
+ * in memory they are moved down in `_mbuf` (always to where nothing is needed anymore).
+ * Buffers that overlap are kept as one, so files that share their buffer still do.
+ */
+static int _mrs_compact_move(MRS* mrs, struct mrs_file_t* const* files, size_t n, uint32_t* offsets, FILE* fp, unsigned char* buf,
+                             size_t* size){
+    size_t i, off, fend, start = 0, end = 0, base = 0, pos = 0;
+
+    for(i=0; i<n; i++){
+        off  = files[i]->dh.h.offset;
+        fend = off + files[i]->dh.h.compressed_size;
+
+        // A new run of buffers starts where the last one ended, however far it was
+        if(!i || off >= end){
+            start = end = off;
+            base  = pos;
+        }
+
+        if(fend > end){
+            if(fp && !_mrs_compact_copy_file(mrs, fp, buf, end, fend - end))
+                return 0;
+            if(!fp && pos != end)
+                memmove(mrs->_mbuf + pos, mrs->_mbuf + end, fend - end);
+            pos += fend - end;
+            end  = fend;
+        }
+
+        offsets[i] = (uint32_t)(base + (off - start));
+    }
+
+    *size = pos;
+
+    return 1;
+}
+
+static int _mrs_compact(MRS* mrs){
+    struct mrs_file_t** files;
+    uint32_t*           offsets;
+    unsigned char*      buf = NULL;
+    unsigned char*      temp;
+    FILE*               fp = NULL;
+    size_t              n, i, size;
+    int                 e = MRSE_OK;
+
+    files = _mrs_compact_files(mrs, &n);
+    if(!files)
+        return MRSE_INSUFFICIENT_MEM;
+
+    // Nothing is moved unless every buffer is where it should be
+    for(i=0; i<n && (size_t)files[i]->dh.h.offset + files[i]->dh.h.compressed_size <= mrs->_mbuf_size; i++);
+    if(i < n){
+        free(files);
+        return MRSE_CANNOT_OPEN;
+    }
+
+    offsets = (uint32_t*)malloc(sizeof(uint32_t) * (n ? n : 1));
+    if(!offsets){
+        free(files);
+        return MRSE_INSUFFICIENT_MEM;
+    }
+
+    // A temporary file is copied to a new one, so nothing is lost if it fails halfway
+    if(mrs->_mtype == MRSMT_TEMPFILE){
+        buf = (unsigned char*)malloc(MRS_COMPACT_STEP);
+        fp  = buf ? tmpfile() : NULL;
+        if(!fp)
+            e = buf ? MRSE_CANNOT_OPEN : MRSE_INSUFFICIENT_MEM;
+    }
+
+    if(e == MRSE_OK && (!_mrs_compact_move(mrs, files, n, offsets, fp, buf, &size) || (fp && fflush(fp))))
+        e = MRSE_CANNOT_OPEN;
+
+    if(e != MRSE_OK){
+        if(fp)
+            fclose(fp);
+        free(buf);
+        free(offsets);
+        free(files);
+        return e;
+    }
+
+    if(fp){
+        fclose(mrs->_fbuf);
+        mrs->_fbuf = fp;
+    }else{
+        temp = (unsigned char*)realloc(mrs->_mbuf, size ? size : 1);
+        if(temp){
+            mrs->_mbuf     = temp;
+            mrs->_mbuf_cap = size ? size : 1;
+        }
+    }
+
+    for(i=0; i<n; i++){
+        _mrs_cache_move(mrs, files[i], offsets[i]);
+        files[i]->dh.h.offset = offsets[i];
+    }
+
+    dbgprintf("Temporary storage compacted from %u to %u bytes", mrs->_mbuf_size, size);
+    mrs->_compactions++;
+    mrs->_reclaimed += mrs->_mbuf_size - size;
+    mrs->_mbuf_size  = size;
+    mrs->_mbuf_dead  = 0;
+
+    free(buf);
+    free(offsets);
+    free(files);
+
+    return MRSE_OK;
+}
+
+/**< `1` if `dead` bytes of the temporary storage are more than `mrs_set_compact_threshold` allows. */
+static int _mrs_compact_due(const MRS* mrs, size_t dead){
+    return mrs->_compact_threshold && dead >= MRS_COMPACT_MIN
+           && (unsigned long long)dead * 100 >= (unsigned long long)mrs->_mbuf_size * mrs->_compact_threshold;
+}
+
+/**< Compacts the temporary storage if it has more dead space than `mrs_set_compact_threshold` allows. */
+void _mrs_compact_auto(MRS* mrs){
+    struct mrs_file_t** files;
+    size_t n, live;
+
+    if(!_mrs_compact_due(mrs, mrs->_mbuf_dead))
+        return;
+
+    // What was counted can be off (files sharing a buffer, files that never made it in), so it's counted again
+    files = _mrs_compact_files(mrs, &n);
+    if(!files)
+        return;
+    live = _mrs_compact_live(files, n);
+    mrs->_mbuf_dead = mrs->_mbuf_size > live ? mrs->_mbuf_size - live : 0;
+    free(files);
+
+    if(_mrs_compact_due(mrs, mrs->_mbuf_dead))
+        _mrs_compact(mrs);
+}
+
+int mrs_compact(MRS* mrs){
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    return _mrs_compact(mrs);
+}
+
+int mrs_set_compact_threshold(MRS* mrs, unsigned percent){
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(percent > 100)
+        return MRSE_INVALID_PARAM;
+
+    dbgprintf("Setting compact threshold to %u%%", percent);
+    mrs->_compact_threshold = percent;
+
+    return MRSE_OK;
+}
+
+int mrs_get_storage_stats(const MRS* mrs, struct mrs_storage_stats_t* stats){
+    struct mrs_file_t** files;
+    size_t n;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(!stats)
+        return MRSE_INVALID_PARAM;
+
+    files = _mrs_compact_files(mrs, &n);
+    if(!files)
+        return MRSE_INSUFFICIENT_MEM;
+
+    memset(stats, 0, sizeof(struct mrs_storage_stats_t));
+    stats->size        = mrs->_mbuf_size;
+    stats->live        = _mrs_compact_live(files, n);
+    stats->dead        = stats->size > stats->live ? stats->size - stats->live : 0;
+    stats->files       = n;
+    stats->compactions = mrs->_compactions;
+    stats->reclaimed   = mrs->_reclaimed;
+
+    free(files);
+
+    return MRSE_OK;
+}
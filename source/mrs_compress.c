@@ -0,0 +1,373 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef LIBMRS_LIBDEFLATE
+#include "libdeflate.h"
+#endif
+
+#include "mrs.h"
+#include "mrs_error.h"
+
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+       /// FROM mrs_util.c
+extern int _mrs_is_initialized(const MRS* mrs);
+       /// FROM mrs_util.c
+extern void _mrs_file_clear_flags(struct mrs_file_t* f, long flags);
+       /// FROM mrs_util.c
+extern long _mrs_file_flags(const struct mrs_file_t* f);
+       /// FROM mrs_util.c
+extern void _mrs_file_set_flags(struct mrs_file_t* f, long flags);
+       /// FROM mrs.c
+extern int _mrs_write(MRS* mrs, unsigned index, const unsigned char* buf, size_t buf_size, const struct mrs_compression_t* c);
+       /// FROM utils.c
+extern size_t _compress_file(const unsigned char* inbuf, size_t total_in, unsigned char* outbuf, size_t out_size, int level, int strategy, size_t probe, unsigned probe_ratio);
+       /// FROM utils.c
+extern void _mrs_thread_register();
+       /// FROM utils.c
+extern int _uncompress_file(const unsigned char* inbuf, size_t total_in, unsigned char* outbuf, size_t uncompressed_size);
+       /// FROM mrs_ccache.c
+extern uint64_t _mrs_ccache_hash(const unsigned char* buf, size_t size);
+       /// FROM mrs_ccache.c
+extern int _mrs_ccache_get(const MRS* mrs, uint64_t hash, const struct mrs_compression_t* c, int predict, const struct mrs_codec_t* codec, struct mrs_packed_t* p);
+       /// FROM mrs_ccache.c
+extern void _mrs_ccache_put(const MRS* mrs, uint64_t hash, const struct mrs_compression_t* c, int predict, const struct mrs_codec_t* codec, const struct mrs_packed_t* p);
+
+static const struct mrs_codec_t _mrs_codec_zlib = {"zlib", _compress_file, _uncompress_file};
+
+#ifdef LIBMRS_LIBDEFLATE
+/*
+    libdeflate (de)compressors of each thread, as with the zlib streams,
+    a compressor is for one level, so it's made again when the level changes
+*/
+static MRS_THREAD_LOCAL struct libdeflate_compressor*   _ld_compressor;
+static MRS_THREAD_LOCAL int                             _ld_level;
+static MRS_THREAD_LOCAL struct libdeflate_decompressor* _ld_decompressor;
+
+static size_t _mrs_ld_deflate(const unsigned char* in, size_t in_size, unsigned char* out, size_t out_size,
+                              int level, int strategy, size_t probe, unsigned probe_ratio){
+    size_t r;
+
+    if(!_ld_compressor || _ld_level != level){
+        if(_ld_compressor)
+            libdeflate_free_compressor(_ld_compressor);
+        _ld_compressor = libdeflate_alloc_compressor(level);
+        if(!_ld_compressor)
+            return 0;
+        _mrs_thread_register();
+        _ld_level = level;
+    }
+
+    // It deflates everything in one go, there's no giving up halfway, `probe` only saves time with zlib
+    r = libdeflate_deflate_compress(_ld_compressor, in, in_size, out, out_size);
+    dbgprintf("File compressed: from %u bytes to %u bytes", in_size, r);
+
+    return r;
+}
+
+static int _mrs_ld_inflate(const unsigned char* in, size_t in_size, unsigned char* out, size_t out_size){
+    if(!_ld_decompressor){
+        _ld_decompressor = libdeflate_alloc_decompressor();
+        if(!_ld_decompressor)
+            return 1;
+        _mrs_thread_register();
+    }
+
+    // Without `actual_out_nbytes_ret`, anything but exactly `out_size` bytes is an error
+    return libdeflate_deflate_decompress(_ld_decompressor, in, in_size, out, out_size, NULL) != LIBDEFLATE_SUCCESS;
+}
+
+static const struct mrs_codec_t _mrs_codec_libdeflate = {"libdeflate", _mrs_ld_deflate, _mrs_ld_inflate};
+#endif
+
+/**< Extensions of files that are compressed already */
+static const char* _mrs_stored_exts[] = {
+    "ogg", "mp3", "jpg", "jpeg", "png", "gif", "webp", "zip", "gz", "7z", "rar", "mrs"
+};
+
+/**< How files that are compressed already start */
+static const struct mrs_magic_t _mrs_stored_magics[] = {
+    {0, "OggS", 4},
+    {0, "ID3", 3},
+    {0, "\xFF\xFB", 2},
+    {0, "\xFF\xF3", 2},
+    {0, "\xFF\xD8\xFF", 3},
+    {0, "\x89PNG", 4},
+    {0, "GIF8", 4},
+    {8, "WEBP", 4},
+    {0, "PK\x03\x04", 4},
+    {0, "\x1F\x8B", 2},
+    {0, "7z\xBC\xAF", 4},
+    {0, "Rar!", 4}
+};
+
+/**< `1` if `c` is something `mrs_set_compression` takes. */
+static int _mrs_compression_valid(const struct mrs_compression_t* c){
+    return c->level >= MRSCL_STORE && c->level <= MRSCL_BEST && c->strategy >= MRSCS_DEFAULT && c->strategy <= MRSCS_FIXED;
+}
+
+/**< How file `f` of `mrs` is compressed when written to. */
+const struct mrs_compression_t* _mrs_file_compression(const MRS* mrs, const struct mrs_file_t* f){
+    return (_mrs_file_flags(f) & MRSFF_COMPRESSION) ? &f->comp : &mrs->_comp;
+}
+
+/**< `1` if file `name` is compressed already, going by its extension. */
+static int _mrs_predict_ext(const char* name){
+    const char* ext;
+    size_t      i;
+
+    if(!name)
+        return 0;
+
+    ext = strrchr(name, '.');
+    if(!ext || strpbrk(ext, "/\\"))
+        return 0;
+
+    for(i=0; i<sizeof(_mrs_stored_exts) / sizeof(_mrs_stored_exts[0]); i++){
+        if(!stricmp(ext + 1, _mrs_stored_exts[i]))
+            return 1;
+    }
+
+    return 0;
+}
+
+/**< `1` if `buf` is compressed already, going by how it starts. */
+static int _mrs_predict_magic(const unsigned char* buf, size_t size){
+    const struct mrs_magic_t* m;
+    size_t i;
+
+    for(i=0; i<sizeof(_mrs_stored_magics) / sizeof(_mrs_stored_magics[0]); i++){
+        m = &_mrs_stored_magics[i];
+        if(m->offset + m->len <= size && !memcmp(buf + m->offset, m->bytes, m->len))
+            return 1;
+    }
+
+    return 0;
+}
+
+/**< Bits per byte of `MRS_PREDICT_SAMPLE` bytes of `buf`, taken from all over it. */
+static double _mrs_predict_entropy(const unsigned char* buf, size_t size){
+    size_t count[256] = {0};
+    size_t piece, step, n = 0, i, j;
+    double h = 0;
+
+    piece = MRS_PREDICT_SAMPLE / MRS_PREDICT_SAMPLES;
+    if(size <= MRS_PREDICT_SAMPLE){
+        piece = size;
+        step  = size;
+    }else
+        step = size / MRS_PREDICT_SAMPLES;
+
+    for(i=0; i + piece <= size; i += step){
+        for(j=0; j<piece; j++)
+            count[buf[i + j]]++;
+        n += piece;
+    }
+
+    for(i=0; i<256; i++){
+        if(count[i])
+            h -= (double)count[i] / n * log((double)count[i] / n);
+    }
+
+    return h / log(2.0);
+}
+
+/**< `1` if `buf`, of file `name`, is sure not to get much smaller when deflated. */
+static int _mrs_predict_store(const unsigned char* buf, size_t size, const char* name){
+    double h;
+
+    if(_mrs_predict_ext(name) || _mrs_predict_magic(buf, size)){
+        dbgprintf("\"%s\" is compressed already", name ? name : "");
+        return 1;
+    }
+
+    h = _mrs_predict_entropy(buf, size);
+    if(h >= MRS_PREDICT_ENTROPY){
+        dbgprintf("\"%s\" looks random, %.2f bits per byte", name ? name : "", h);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**< DEFLATE backend of `mrs`. */
+const struct mrs_codec_t* _mrs_codec(const MRS* mrs){
+    return mrs->_codec ? mrs->_codec : &_mrs_codec_zlib;
+}
+
+/**< Inflates `in` into `out` with the backend of `mrs`, `0` if it comes out exactly `out_size` bytes. */
+int _mrs_inflate(const MRS* mrs, const unsigned char* in, size_t in_size, unsigned char* out, size_t out_size){
+    return _mrs_codec(mrs)->inflate(in, in_size, out, out_size);
+}
+
+/**< Frees what the backends keep for the calling thread. */
+void _mrs_codec_thread_cleanup(){
+#ifdef LIBMRS_LIBDEFLATE
+    if(_ld_compressor)
+        libdeflate_free_compressor(_ld_compressor);
+    if(_ld_decompressor)
+        libdeflate_free_decompressor(_ld_decompressor);
+    _ld_compressor   = NULL;
+    _ld_decompressor = NULL;
+#endif
+}
+
+/**
+ * Computes the CRC32 of `buffer` and compresses it into `p` with the backend of `mrs` as `c` says, it's stored as is
+ * if it can't be compressed. With `MRSF_PREDICT`, it's also stored as is if it doesn't look like it'd get smaller,
+ * `name` is the name of the file (optional). With a compression cache, what's in there is taken instead of compressing
+ * again, and what's compressed goes in there.
+ */
+int _mrs_pack(const MRS* mrs, const struct mrs_compression_t* c, const void* buffer, size_t buffer_size, const char* name,
+              struct mrs_packed_t* p){
+    const struct mrs_codec_t* codec = _mrs_codec(mrs);
+    uint64_t hash = 0;
+    size_t   csize = 0;
+    int      predict = mrs->_flags & MRSF_PREDICT;
+    int      shrink, cached;
+
+    p->size        = buffer_size;
+    p->crc32       = crc32(0, Z_NULL, 0);
+    p->compression = MRSCM_DEFLATE;
+    p->buf         = NULL;
+    p->csize       = 0;
+
+    if(!buffer_size){
+        p->compression = MRSCM_STORE;
+        return MRSE_OK;
+    }
+
+    p->crc32 = crc32(p->crc32, (const Bytef*)buffer, buffer_size);
+
+    shrink = c->level != MRSCL_STORE;
+    if(shrink && predict && buffer_size >= MRS_PREDICT_MIN)
+        shrink = !_mrs_predict_store((const unsigned char*)buffer, buffer_size, name);
+
+    cached = shrink && mrs->_ccache;
+    if(cached){
+        hash = _mrs_ccache_hash((const unsigned char*)buffer, buffer_size);
+        if(_mrs_ccache_get(mrs, hash, c, predict, codec, p)){
+            if(p->compression == MRSCM_DEFLATE)
+                return MRSE_OK;
+            shrink = cached = 0;
+        }
+    }
+
+    if(shrink){
+        p->buf = (unsigned char*)malloc(buffer_size + 16);
+        if(!p->buf)
+            return MRSE_INSUFFICIENT_MEM;
+        csize = codec->deflate((const unsigned char*)buffer, buffer_size, p->buf, buffer_size + 16, c->level, c->strategy,
+                               predict ? MRS_PREDICT_PROBE : 0, MRS_PREDICT_RATIO);
+        if(csize && (!predict || csize < buffer_size)){
+            p->csize = csize;
+            if(cached)
+                _mrs_ccache_put(mrs, hash, c, predict, codec, p);
+            return MRSE_OK;
+        }
+        free(p->buf);
+        p->buf = NULL;
+    }
+
+    p->buf = (unsigned char*)malloc(buffer_size);
+    if(!p->buf)
+        return MRSE_INSUFFICIENT_MEM;
+    memcpy(p->buf, buffer, buffer_size);
+    p->csize       = buffer_size;
+    p->compression = MRSCM_STORE;
+
+    // It didn't get smaller, next time it's stored right away
+    if(cached)
+        _mrs_ccache_put(mrs, hash, c, predict, codec, p);
+
+    return MRSE_OK;
+}
+
+/**
+ * Sets how file `index` of `mrs` is compressed, `NULL` to go back to the handle's, and compresses it again that way.
+ */
+int _mrs_set_file_compression(MRS* mrs, unsigned index, const struct mrs_compression_t* c){
+    struct mrs_file_t* f = &mrs->_files[index];
+    unsigned char*     buf;
+    size_t             size;
+    int                r;
+
+    if(c && !_mrs_compression_valid(c))
+        return MRSE_INVALID_PARAM;
+
+    buf = (unsigned char*)malloc(f->dh.h.uncompressed_size ? f->dh.h.uncompressed_size : 1);
+    if(!buf)
+        return MRSE_INSUFFICIENT_MEM;
+
+    r = mrs_read(mrs, index, buf, f->dh.h.uncompressed_size, &size);
+    if(r == MRSE_OK)
+        r = _mrs_write(mrs, index, buf, size, c ? c : &mrs->_comp);
+    free(buf);
+
+    if(r != MRSE_OK)
+        return r;
+
+    // Only once it's written again, so the file is left as it was if that fails
+    if(c){
+        f->comp = *c;
+        _mrs_file_set_flags(f, MRSFF_COMPRESSION);
+    }else
+        _mrs_file_clear_flags(f, MRSFF_COMPRESSION);
+
+    dbgprintf("File %u compressed again with level %d, strategy %d: %u bytes", index, _mrs_file_compression(mrs, f)->level, _mrs_file_compression(mrs, f)->strategy, f->dh.h.compressed_size);
+
+    return MRSE_OK;
+}
+
+int mrs_set_compression(MRS* mrs, int level, int strategy){
+    struct mrs_compression_t c;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    c.level    = level;
+    c.strategy = strategy;
+    if(!_mrs_compression_valid(&c))
+        return MRSE_INVALID_PARAM;
+
+    dbgprintf("Setting compression to level %d, strategy %d", level, strategy);
+    mrs->_comp = c;
+
+    return MRSE_OK;
+}
+
+int mrs_set_codec(MRS* mrs, const mrs_codec_t* codec){
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(codec && (!codec->deflate || !codec->inflate))
+        return MRSE_INVALID_PARAM;
+
+    dbgprintf("Setting codec to %s", codec && codec->name ? codec->name : "zlib");
+    mrs->_codec = codec;
+
+    return MRSE_OK;
+}
+
+const mrs_codec_t* mrs_codec_zlib(){
+    return &_mrs_codec_zlib;
+}
+
+const mrs_codec_t* mrs_codec_libdeflate(){
+#ifdef LIBMRS_LIBDEFLATE
+    return &_mrs_codec_libdeflate;
+#else
+    return NULL;
+#endif
+}
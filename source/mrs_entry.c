@@ -0,0 +1,179 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mrs.h"
+#include "mrs_error.h"
+#include "zlib.h"
+
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+       /// FROM mrs_util.c
+extern int _mrs_is_initialized(const MRS* mrs);
+       /// FROM mrs_util.c
+extern int _mrs_file_read_at(const MRS* mrs, struct mrs_file_t* f, unsigned char* buf, size_t pos, size_t size);
+       /// FROM mrs_util.c
+extern const unsigned char* _mrs_file_ptr(const MRS* mrs, struct mrs_file_t* f);
+       /// FROM mrs_util.c
+extern void _mrs_lock(const MRS* mrs);
+       /// FROM mrs_util.c
+extern void _mrs_unlock(const MRS* mrs);
+       /// FROM mrs_source.c
+extern void _mrs_source_ref(MRS* mrs, unsigned src);
+       /// FROM mrs_source.c
+extern int _mrs_file_resolve(const MRS* mrs, struct mrs_file_t* f);
+       /// FROM mrs_source.c
+extern void _mrs_source_release(MRS* mrs, unsigned src);
+
+int mrs_entry_open(const MRS* mrs, unsigned index, MRS_ENTRY** entry){
+    struct mrs_entry_t* e;
+    const unsigned char* ptr;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(!entry)
+        return MRSE_INVALID_PARAM;
+
+    if(index >= mrs->_hdr.dir_count)
+        return MRSE_INVALID_INDEX;
+
+    // The copy below has to know where the file buffer is
+    if(!_mrs_file_resolve(mrs, &mrs->_files[index]))
+        return MRSE_INVALID_ENCRYPTION;
+
+    e = (struct mrs_entry_t*)malloc(sizeof(struct mrs_entry_t));
+    if(!e)
+        return MRSE_INSUFFICIENT_MEM;
+    memset(e, 0, sizeof(struct mrs_entry_t));
+
+    e->mrs = mrs;
+    memcpy(&e->f, &mrs->_files[index], sizeof(struct mrs_file_t));
+    // The names belong to the handle, the stream doesn't need them
+    e->f.lh.filename = e->f.dh.filename = NULL;
+    e->f.zidx = NULL;
+
+    if(e->f.dh.h.compression != MRSCM_STORE){
+        e->z.zalloc = Z_NULL;
+        e->z.zfree  = Z_NULL;
+        e->z.opaque = Z_NULL;
+        e->z.next_in  = Z_NULL;
+        e->z.avail_in = 0;
+        if(inflateInit2(&e->z, -MAX_WBITS) != Z_OK){
+            free(e);
+            return MRSE_CANNOT_UNCOMPRESS;
+        }
+        e->zinit = 1;
+
+        // If it's mapped, we can inflate it right from there (not from the memory storage, it moves when it grows)
+        ptr = e->f.src ? _mrs_file_ptr(mrs, &e->f) : NULL;
+        if(ptr){
+            e->z.next_in  = (Bytef*)ptr;
+            e->z.avail_in = e->f.dh.h.compressed_size;
+            e->cpos       = e->f.dh.h.compressed_size;
+        }else{
+            e->win = (unsigned char*)malloc(MRS_ENTRY_WINDOW);
+            if(!e->win){
+                inflateEnd(&e->z);
+                free(e);
+                return MRSE_INSUFFICIENT_MEM;
+            }
+        }
+    }
+
+    // Keep the archive open even if the file is removed from the handle meanwhile
+    _mrs_lock(mrs);
+    _mrs_source_ref((MRS*)mrs, e->f.src);
+    _mrs_unlock(mrs);
+
+    dbgprintf("Opened stream for file %u (%u bytes, %u compressed)", index, e->f.dh.h.uncompressed_size, e->f.dh.h.compressed_size);
+
+    *entry = e;
+
+    return MRSE_OK;
+}
+
+int mrs_entry_read(MRS_ENTRY* entry, unsigned char* buf, size_t buf_size, size_t* out_size){
+    struct mrs_entry_t* e = entry;
+    size_t n;
+    int r;
+
+    if(!e || !out_size || (!buf && buf_size))
+        return MRSE_INVALID_PARAM;
+
+    *out_size = 0;
+
+    if(e->done || !buf_size)
+        return MRSE_OK;
+
+    if(e->f.dh.h.compression == MRSCM_STORE){
+        n = e->f.dh.h.compressed_size - e->cpos;
+        if(n > buf_size)
+            n = buf_size;
+        if(!_mrs_file_read_at(e->mrs, &e->f, buf, e->cpos, n))
+            return MRSE_CANNOT_OPEN;
+        e->cpos += n;
+        e->upos += n;
+        e->done  = (e->cpos == e->f.dh.h.compressed_size);
+        *out_size = n;
+        return MRSE_OK;
+    }
+
+    e->z.next_out  = (Bytef*)buf;
+    e->z.avail_out = buf_size;
+
+    while(e->z.avail_out){
+        if(!e->z.avail_in && e->cpos < e->f.dh.h.compressed_size){
+            n = e->f.dh.h.compressed_size - e->cpos;
+            if(n > MRS_ENTRY_WINDOW)
+                n = MRS_ENTRY_WINDOW;
+            if(!_mrs_file_read_at(e->mrs, &e->f, e->win, e->cpos, n))
+                return MRSE_CANNOT_OPEN;
+            e->cpos       += n;
+            e->z.next_in  = (Bytef*)e->win;
+            e->z.avail_in = n;
+        }
+
+        r = inflate(&e->z, Z_NO_FLUSH);
+        if(r == Z_STREAM_END){
+            e->done = 1;
+            break;
+        }
+        if(r != Z_OK && !(r == Z_BUF_ERROR && e->z.avail_in)){
+            dbgprintf("Inflating failed (%d) at %u of %u compressed bytes", r, e->cpos, e->f.dh.h.compressed_size);
+            return MRSE_CANNOT_UNCOMPRESS;
+        }
+    }
+
+    n = buf_size - e->z.avail_out;
+    e->upos += n;
+    *out_size = n;
+
+    return MRSE_OK;
+}
+
+int mrs_entry_close(MRS_ENTRY* entry){
+    struct mrs_entry_t* e = entry;
+
+    if(!e)
+        return MRSE_INVALID_PARAM;
+
+    if(e->zinit)
+        inflateEnd(&e->z);
+    free(e->win);
+    _mrs_lock(e->mrs);
+    _mrs_source_release((MRS*)e->mrs, e->f.src);
+    _mrs_unlock(e->mrs);
+    free(e);
+
+    return MRSE_OK;
+}
@@ -16,14 +16,27 @@ void _mrs_file_init(struct mrs_file_t* f){
     memset(f, 0, sizeof(struct mrs_file_t));
 }
 
+/**< Drops the inflate checkpoints of `f`, for when its contents change (or go away). */
+void _mrs_file_drop_index(struct mrs_file_t* f){
+    if(!f->zidx)
+        return;
+    free(f->zidx->points);
+    free(f->zidx);
+    f->zidx = NULL;
+}
+
 void _mrs_file_free(struct mrs_file_t* f) {
-    if (f->lh.filename != f->dh.filename) {
-        dbgprintf("We got different filenames between LOCAL and CENTRAL DIR headers");
-        free(f->lh.filename);
-        dbgprintf("Freed LOCAL filename");
+    _mrs_file_drop_index(f);
+    // Pooled names are freed along with the handle
+    if (!(f->flags & MRSFF_NAME_POOLED)) {
+        if (f->lh.filename != f->dh.filename) {
+            dbgprintf("We got different filenames between LOCAL and CENTRAL DIR headers");
+            free(f->lh.filename);
+            dbgprintf("Freed LOCAL filename");
+        }
+        free(f->dh.filename);
+        dbgprintf("Freed CENTRAL DIR filename");
     }
-    free(f->dh.filename);
-    dbgprintf("Freed CENTRAL DIR filename");
     f->lh.filename = NULL;
     f->dh.filename = NULL;
     f->lh.extra    = NULL;
@@ -34,15 +47,37 @@ void _mrs_file_free(struct mrs_file_t* f) {
 void _mrs_files_init(struct mrs_files_t* f){
     f->files = NULL;
     f->count = 0;
+    f->cap   = 0;
 }
 
-void _mrs_files_append(struct mrs_files_t* f, const struct mrs_file_t* ff){
+/**< Makes room for `n` files in total. */
+int _mrs_files_reserve(struct mrs_files_t* f, size_t n){
+    struct mrs_file_t* files;
+
+    if(n <= f->cap)
+        return 1;
+
+    files = (struct mrs_file_t*)realloc(f->files, sizeof(struct mrs_file_t) * n);
+    if(!files)
+        return 0;
+
+    f->files = files;
+    f->cap   = n;
+
+    return 1;
+}
+
+/**< Returns 0 if there's no memory for one more file, leaving `f` as it was. */
+int _mrs_files_append(struct mrs_files_t* f, const struct mrs_file_t* ff){
     size_t i = f->count;
 
-    f->files = (struct mrs_files_t*)realloc(f->files, sizeof(struct mrs_file_t) * (i + 1));
+    if(i == f->cap && !_mrs_files_reserve(f, f->cap ? f->cap * 2 : 16))
+        return 0;
     f->count++;
 
     memcpy(&f->files[i], ff, sizeof(struct mrs_file_t));
+
+    return 1;
 }
 
 void _mrs_files_destroy(struct mrs_files_t* f, int freefiles){
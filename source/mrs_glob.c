@@ -0,0 +1,302 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mrs.h"
+#include "mrs_error.h"
+
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+       /// FROM mrs_util.c
+extern int _mrs_is_initialized(const MRS* mrs);
+       /// FROM mrs_index.c
+extern unsigned char _mrs_name_char(unsigned char c);
+       /// FROM mrs_index.c
+extern int _mrs_name_cmp(const char* a, const char* b, size_t n);
+       /// FROM mrs_list.c
+extern int _mrs_names_ready(const MRS* mrs);
+       /// FROM mrs_list.c
+extern size_t _mrs_names_bound(const MRS* mrs, const char* s, size_t len, int upper);
+
+static void _mrs_glob_set(struct mrs_glob_tok_t* t, unsigned char c){
+    c = _mrs_name_char(c);
+    t->set[c >> 3] |= 1 << (c & 7);
+}
+
+/**< Reads the set `[...]` at `p` into `t`, returns what comes after it, `NULL` if it has no `]`. */
+static const char* _mrs_glob_compile_set(struct mrs_glob_tok_t* t, const char* p){
+    int      neg = 0;
+    unsigned c, i;
+
+    p++;
+    if(*p == '!' || *p == '^'){
+        neg = 1;
+        p++;
+    }
+
+    // A `]` right away is part of the set
+    do{
+        if(!*p)
+            return NULL;
+        if(p[1] == '-' && p[2] && p[2] != ']'){
+            for(c = (unsigned char)p[0]; c <= (unsigned char)p[2]; c++)
+                _mrs_glob_set(t, c);
+            p += 3;
+        }else{
+            _mrs_glob_set(t, *p);
+            p++;
+        }
+    }while(*p != ']');
+
+    if(neg){
+        for(i=0; i<sizeof(t->set); i++)
+            t->set[i] = ~t->set[i];
+    }
+
+    return p + 1;
+}
+
+static void _mrs_glob_free(struct mrs_glob_t* g){
+    free(g->toks);
+    free(g->lit);
+    memset(g, 0, sizeof(struct mrs_glob_t));
+}
+
+/**< Turns `pattern` into the tokens of `g`. */
+static int _mrs_glob_compile(struct mrs_glob_t* g, const char* pattern){
+    struct mrs_glob_tok_t* t;
+    const char* p = pattern;
+    size_t      i;
+
+    memset(g, 0, sizeof(struct mrs_glob_t));
+
+    // Never more tokens than characters
+    g->toks = (struct mrs_glob_tok_t*)calloc(strlen(pattern) + 1, sizeof(struct mrs_glob_tok_t));
+    if(!g->toks)
+        return MRSE_INSUFFICIENT_MEM;
+
+    while(*p){
+        t = &g->toks[g->count++];
+        switch(*p){
+        case '*':
+            if(p[1] != '*'){
+                t->type = MRSGT_STAR;
+                p++;
+                break;
+            }
+            for(p += 2; *p == '*'; p++);
+            if(*p == '/' || *p == '\\'){
+                t->type = MRSGT_DIRS;
+                p++;
+            }else
+                t->type = MRSGT_DSTAR;
+            break;
+        case '?':
+            t->type = MRSGT_ANY;
+            p++;
+            break;
+        case '[':
+            t->type = MRSGT_SET;
+            p = _mrs_glob_compile_set(t, p);
+            if(!p){
+                dbgprintf("No ] in \"%s\"", pattern);
+                _mrs_glob_free(g);
+                return MRSE_INVALID_PARAM;
+            }
+            break;
+        default:
+            t->type = MRSGT_CHAR;
+            t->c    = _mrs_name_char(*p++);
+        }
+    }
+
+    for(g->prefix = 0; g->prefix < g->count && g->toks[g->prefix].type == MRSGT_CHAR; g->prefix++);
+    if(g->prefix < g->count)
+        for(g->suffix = 0; g->suffix < g->count && g->toks[g->count - 1 - g->suffix].type == MRSGT_CHAR; g->suffix++);
+
+    g->lit = (char*)malloc(g->prefix + 1);
+    if(!g->lit){
+        _mrs_glob_free(g);
+        return MRSE_INSUFFICIENT_MEM;
+    }
+    for(i=0; i<g->prefix; i++)
+        g->lit[i] = g->toks[i].c;
+    g->lit[i] = 0;
+
+    return MRSE_OK;
+}
+
+/**
+ * Adds to `st` the tokens right after the ones in it that can match nothing.
+ * `st[k]` is `1` if token `k` is just being started, `2` if it's matching already, `MRSGT_DIRS` only matches no
+ * folders when it's just started (it matched something otherwise, which has to end with a `/`).
+ */
+static void _mrs_glob_close(const struct mrs_glob_t* g, unsigned char* st){
+    size_t k;
+
+    for(k=0; k<g->count; k++){
+        if(g->toks[k].type == MRSGT_DIRS ? (st[k] & 1) : (st[k] && g->toks[k].type >= MRSGT_STAR))
+            st[k + 1] |= 1;
+    }
+}
+
+/**
+ * Checks if `s`, which starts with `g->lit` already, matches `g`.
+ * The tokens are followed all at once (`cur` and `next`, room for `g->count + 1` each, are the ones being followed),
+ * so there's no going back and it takes as long as `s` times the tokens at worst.
+ */
+static int _mrs_glob_match(const struct mrs_glob_t* g, const char* s, unsigned char* cur, unsigned char* next){
+    const struct mrs_glob_tok_t* t;
+    unsigned char* swap;
+    unsigned char  c;
+    size_t         len, k;
+    int            any;
+
+    s  += g->prefix;
+    len = strlen(s);
+
+    if(g->prefix == g->count)
+        return !len;
+
+    // Most patterns end in an extension, which rules out most names right away
+    if(len < g->suffix)
+        return 0;
+    for(k=0; k<g->suffix; k++){
+        if(_mrs_name_char(s[len - 1 - k]) != g->toks[g->count - 1 - k].c)
+            return 0;
+    }
+
+    memset(cur, 0, g->count + 1);
+    cur[g->prefix] = 1;
+    _mrs_glob_close(g, cur);
+
+    for(; *s; s++){
+        c   = _mrs_name_char(*s);
+        any = 0;
+        memset(next, 0, g->count + 1);
+
+        for(k=0; k<g->count; k++){
+            if(!cur[k])
+                continue;
+            t = &g->toks[k];
+            switch(t->type){
+            case MRSGT_CHAR:
+                next[k + 1] |= (t->c == c);
+                break;
+            case MRSGT_ANY:
+                next[k + 1] |= (c != '/');
+                break;
+            case MRSGT_SET:
+                next[k + 1] |= (c != '/' && (t->set[c >> 3] & (1 << (c & 7))));
+                break;
+            case MRSGT_STAR:
+                next[k] |= (c != '/') << 1;
+                break;
+            case MRSGT_DSTAR:
+                next[k] |= 2;
+                break;
+            case MRSGT_DIRS:
+                next[k] |= 2;
+                next[k + 1] |= (c == '/');
+                break;
+            }
+        }
+
+        _mrs_glob_close(g, next);
+        for(k=0; k<=g->count && !any; k++)
+            any = next[k];
+        if(!any)
+            return 0;
+
+        swap = cur;
+        cur  = next;
+        next = swap;
+    }
+
+    return cur[g->count];
+}
+
+int mrs_find_globs(const MRS* mrs, const char* const* patterns, size_t count, MRS_LIST_FUNC sink, void* param){
+    struct mrs_glob_t* g;
+    unsigned char*     st;
+    const char*        name;
+    size_t             i, k, next, toks = 0;
+    int                r = MRSE_OK;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(!patterns || !count || !sink)
+        return MRSE_INVALID_PARAM;
+
+    g = (struct mrs_glob_t*)calloc(count, sizeof(struct mrs_glob_t));
+    if(!g)
+        return MRSE_INSUFFICIENT_MEM;
+
+    for(k=0; k<count && r == MRSE_OK; k++){
+        r = patterns[k] ? _mrs_glob_compile(&g[k], patterns[k]) : MRSE_INVALID_PARAM;
+        if(g[k].count > toks)
+            toks = g[k].count;
+    }
+
+    st = NULL;
+    if(r == MRSE_OK){
+        st = (unsigned char*)malloc((toks + 1) * 2);
+        if(!st || !_mrs_names_ready(mrs))
+            r = MRSE_INSUFFICIENT_MEM;
+    }
+    if(r != MRSE_OK){
+        for(k=0; k<count; k++)
+            _mrs_glob_free(&g[k]);
+        free(g);
+        free(st);
+        return r;
+    }
+
+    // Only names starting with the plain characters a pattern starts with can match it
+    for(k=0; k<count; k++){
+        g[k].lo = _mrs_names_bound(mrs, g[k].lit, g[k].prefix, 0);
+        g[k].hi = _mrs_names_bound(mrs, g[k].lit, g[k].prefix, 1);
+        dbgprintf("Pattern %u: %u token(s), %u file(s) to check", k, g[k].count, g[k].hi - g[k].lo);
+    }
+
+    for(i=0; ; i++){
+        // Skip to the next name some pattern can match
+        next = mrs->_names.count;
+        for(k=0; k<count; k++){
+            if(g[k].hi > i && g[k].lo < next)
+                next = g[k].lo > i ? g[k].lo : i;
+        }
+        if(next >= mrs->_names.count)
+            break;
+        i = next;
+
+        name = mrs->_files[mrs->_names.order[i]].dh.filename;
+        for(k=0; k<count; k++){
+            if(g[k].lo <= i && i < g[k].hi && _mrs_glob_match(&g[k], name, st, st + toks + 1))
+                break;
+        }
+        if(k < count && sink(mrs->_names.order[i], name, param))
+            break;
+    }
+
+    for(k=0; k<count; k++)
+        _mrs_glob_free(&g[k]);
+    free(g);
+    free(st);
+
+    return MRSE_OK;
+}
+
+int mrs_find_glob(const MRS* mrs, const char* pattern, MRS_LIST_FUNC sink, void* param){
+    return mrs_find_globs(mrs, &pattern, 1, sink, param);
+}
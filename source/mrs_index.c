@@ -0,0 +1,431 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mrs.h"
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+       /// FROM mrs_list.c
+extern void _mrs_names_add(MRS* mrs, unsigned i);
+       /// FROM mrs_list.c
+extern void _mrs_names_remove(MRS* mrs, unsigned i);
+       /// FROM mrs_list.c
+extern void _mrs_names_shift(MRS* mrs, unsigned i);
+       /// FROM mrs_bloom.c
+extern void _mrs_bloom_add(MRS* mrs, uint32_t h);
+       /// FROM mrs_bloom.c
+extern void _mrs_bloom_remove(MRS* mrs, uint32_t h);
+       /// FROM mrs_bloom.c
+extern int _mrs_bloom_test(const struct mrs_bloom_t* b, uint32_t h);
+
+/**< Smallest number of slots of the index */
+#define MRS_INDEX_MIN 64
+
+/**< `c` as names are compared: lower case, with `\\` the same as `/`. */
+unsigned char _mrs_name_char(unsigned char c){
+    if(c == '\\')
+        return '/';
+    if(c >= 'A' && c <= 'Z')
+        return c - 'A' + 'a';
+    return c;
+}
+
+/**< Goes on with the hash `h` of a name over `s`, so a name can be hashed a piece at a time. */
+uint32_t _mrs_name_hash_from(uint32_t h, const char* s){
+    while(*s){
+        h ^= _mrs_name_char(*s++);
+        h *= 0x01000193;
+    }
+
+    return h;
+}
+
+/**< FNV-1a hash of the name `s`, as it is compared by `_mrs_name_eq`. */
+uint32_t _mrs_name_hash(const char* s){
+    return _mrs_name_hash_from(0x811c9dc5, s);
+}
+
+/**< `1` if `a` and `b` are the same name, case and kind of slash aside. */
+int _mrs_name_eq(const char* a, const char* b){
+    while(*a && _mrs_name_char(*a) == _mrs_name_char(*b)){
+        a++;
+        b++;
+    }
+
+    return !*a && !*b;
+}
+
+/**< Compares at most `n` characters of the names `a` and `b` as `strncmp` does, case and kind of slash aside. */
+int _mrs_name_cmp(const char* a, const char* b, size_t n){
+    for(; n && *a && _mrs_name_char(*a) == _mrs_name_char(*b); n--){
+        a++;
+        b++;
+    }
+
+    return n ? (int)_mrs_name_char(*a) - (int)_mrs_name_char(*b) : 0;
+}
+
+/**
+ * Splits the name `s` in `stem (num)ext`, where `ext` starts at the last `.` of the last part of the path (or is empty).
+ * Returns `0` if there is no ` (num)`, `stem` is everything before `ext` then.
+ */
+static int _mrs_name_split(const char* s, size_t* stem_len, unsigned* num, const char** ext){
+    const char* e = NULL;
+    const char* par;
+    const char* p;
+
+    for(p=s; *p; p++){
+        if(*p == '.')
+            e = p;
+        else if(*p == '/' || *p == '\\')
+            e = NULL;
+    }
+    if(!e)
+        e = p;
+
+    *ext      = e;
+    *stem_len = e - s;
+
+    if(e - s < 4 || e[-1] != ')')
+        return 0;
+
+    for(par = e - 2; par > s && *par >= '0' && *par <= '9'; par--);
+    if(par == e - 2 || *par != '(' || par == s || par[-1] != ' ')
+        return 0;
+
+    // Numbers too big to keep track of all end up as MRS_STEM_MAX_NUM
+    *num = 0;
+    for(p = par + 1; p < e - 1; p++)
+        *num = *num >= MRS_STEM_MAX_NUM ? MRS_STEM_MAX_NUM : *num * 10 + (*p - '0');
+
+    *stem_len = par - 1 - s;
+    return 1;
+}
+
+/**< Hash of the stem `s` (`len` bytes) followed by `ext`, as they are compared. */
+static uint32_t _mrs_stem_hash(const char* s, size_t len, const char* ext){
+    uint32_t h = 0x811c9dc5;
+    size_t   i;
+
+    for(i=0; i<len; i++){
+        h ^= _mrs_name_char(s[i]);
+        h *= 0x01000193;
+    }
+    while(*ext){
+        h ^= _mrs_name_char(*ext++);
+        h *= 0x01000193;
+    }
+
+    return h;
+}
+
+/**< `1` if `key` is the stem `s` (`len` bytes) followed by `ext`. */
+static int _mrs_stem_eq(const char* key, const char* s, size_t len, const char* ext){
+    size_t i;
+
+    for(i=0; i<len; i++, key++){
+        if(*key != _mrs_name_char(s[i]))
+            return 0;
+    }
+    for(; *ext; ext++, key++){
+        if(*key != _mrs_name_char(*ext))
+            return 0;
+    }
+
+    return !*key;
+}
+
+static struct mrs_stem_t* _mrs_stem_find(const struct mrs_stems_t* t, uint32_t h, const char* s, size_t len, const char* ext){
+    size_t i;
+
+    if(!t->cap)
+        return NULL;
+
+    for(i = h & (t->cap - 1); t->slots[i].key; i = (i + 1) & (t->cap - 1)){
+        if(t->slots[i].hash == h && _mrs_stem_eq(t->slots[i].key, s, len, ext))
+            return &t->slots[i];
+    }
+
+    return NULL;
+}
+
+/**< Makes room for one more stem in `t`, moving the ones it has to a bigger table if needed. */
+static int _mrs_stems_grow(struct mrs_stems_t* t){
+    struct mrs_stem_t* slots;
+    size_t cap, i, j;
+
+    if((t->used + 1) * 2 <= t->cap)
+        return 1;
+
+    cap   = t->cap ? t->cap * 2 : MRS_INDEX_MIN;
+    slots = (struct mrs_stem_t*)calloc(cap, sizeof(struct mrs_stem_t));
+    if(!slots)
+        return 0;
+
+    for(i=0; i<t->cap; i++){
+        if(!t->slots[i].key)
+            continue;
+        for(j = t->slots[i].hash & (cap - 1); slots[j].key; j = (j + 1) & (cap - 1));
+        slots[j] = t->slots[i];
+    }
+
+    free(t->slots);
+    t->slots = slots;
+    t->cap   = cap;
+
+    return 1;
+}
+
+static struct mrs_stem_t* _mrs_stem_add(struct mrs_stems_t* t, uint32_t h, const char* s, size_t len, const char* ext){
+    struct mrs_stem_t* st;
+    size_t i;
+
+    st = _mrs_stem_find(t, h, s, len, ext);
+    if(st)
+        return st;
+
+    if(!_mrs_stems_grow(t))
+        return NULL;
+
+    for(i = h & (t->cap - 1); t->slots[i].key; i = (i + 1) & (t->cap - 1));
+    st = &t->slots[i];
+
+    st->key = (char*)malloc(len + strlen(ext) + 1);
+    if(!st->key)
+        return NULL;
+    for(i=0; i<len; i++)
+        st->key[i] = _mrs_name_char(s[i]);
+    for(; *ext; ext++, i++)
+        st->key[i] = _mrs_name_char(*ext);
+    st->key[i] = 0;
+
+    st->hash    = h;
+    st->counts  = NULL;
+    st->ncounts = 0;
+    st->free    = 2;
+    t->used++;
+
+    return st;
+}
+
+/**< Counts `name` in (`delta` = `1`) or out (`delta` = `-1`) of the stems of `mrs`, if it ends in " (N)". */
+static void _mrs_stems_count(MRS* mrs, const char* name, int delta){
+    struct mrs_stem_t* st;
+    const char* ext;
+    unsigned*   counts;
+    size_t      len, n;
+    unsigned    num;
+    uint32_t    h;
+
+    if(!_mrs_name_split(name, &len, &num, &ext) || num >= MRS_STEM_MAX_NUM)
+        return;
+
+    h = _mrs_stem_hash(name, len, ext);
+
+    if(delta < 0){
+        st = _mrs_stem_find(&mrs->_stems, h, name, len, ext);
+        if(!st || num >= st->ncounts || !st->counts[num])
+            return;
+        st->counts[num]--;
+        if(!st->counts[num] && num >= 2 && num < st->free)
+            st->free = num;
+        return;
+    }
+
+    st = _mrs_stem_add(&mrs->_stems, h, name, len, ext);
+    if(!st)
+        return;
+
+    if(num >= st->ncounts){
+        n = st->ncounts ? st->ncounts * 2 : 16;
+        while(n <= num)
+            n *= 2;
+        counts = (unsigned*)realloc(st->counts, n * sizeof(unsigned));
+        if(!counts)
+            return;
+        memset(counts + st->ncounts, 0, (n - st->ncounts) * sizeof(unsigned));
+        st->counts  = counts;
+        st->ncounts = n;
+    }
+
+    st->counts[num]++;
+    while(st->free < st->ncounts && st->counts[st->free])
+        st->free++;
+}
+
+void _mrs_stems_free(MRS* mrs){
+    size_t i;
+
+    for(i=0; i<mrs->_stems.cap; i++){
+        free(mrs->_stems.slots[i].key);
+        free(mrs->_stems.slots[i].counts);
+    }
+    free(mrs->_stems.slots);
+    mrs->_stems.slots = NULL;
+    mrs->_stems.cap   = 0;
+    mrs->_stems.used  = 0;
+}
+
+/**< `s` as `stem (N)ext`, with the lowest N (from `2` on) no file in `mrs` has. */
+char* _mrs_name_next(const MRS* mrs, const char* s){
+    const struct mrs_stem_t* st;
+    const char* ext;
+    size_t      len;
+    unsigned    num;
+    char*       r;
+
+    _mrs_name_split(s, &len, &num, &ext);
+    st  = _mrs_stem_find(&mrs->_stems, _mrs_stem_hash(s, len, ext), s, len, ext);
+    num = st ? st->free : 2;
+
+    r = (char*)malloc(len + strlen(ext) + 16);
+    if(r)
+        sprintf(r, "%.*s (%u)%s", (int)len, s, num, ext);
+
+    return r;
+}
+
+static void _mrs_index_put(struct mrs_index_t* x, uint32_t hash, unsigned i){
+    size_t s = hash & (x->cap - 1);
+
+    while(x->slots[s].index)
+        s = (s + 1) & (x->cap - 1);
+
+    x->slots[s].hash  = hash;
+    x->slots[s].index = i + 1;
+    x->used++;
+}
+
+void _mrs_index_free(MRS* mrs){
+    free(mrs->_index.slots);
+    mrs->_index.slots = NULL;
+    mrs->_index.cap   = 0;
+    mrs->_index.used  = 0;
+}
+
+/**< Indexes all the files of `mrs` again, with room for `n` of them. Without memory for it, there is just no index. */
+void _mrs_index_rebuild(MRS* mrs, size_t n){
+    size_t   cap = MRS_INDEX_MIN;
+    unsigned i;
+
+    // At most half full, so probes stay short
+    while(cap < n * 2)
+        cap *= 2;
+
+    _mrs_index_free(mrs);
+
+    mrs->_index.slots = (struct mrs_index_slot_t*)calloc(cap, sizeof(struct mrs_index_slot_t));
+    if(!mrs->_index.slots){
+        dbgprintf("No memory for the name index, names will be searched one by one");
+        return;
+    }
+    mrs->_index.cap = cap;
+
+    for(i=0; i<mrs->_hdr.dir_count; i++)
+        _mrs_index_put(&mrs->_index, _mrs_name_hash(mrs->_files[i].dh.filename), i);
+}
+
+/**< Indexes file `i` of `mrs`, which was just added. */
+void _mrs_index_add(MRS* mrs, unsigned i){
+    uint32_t h = _mrs_name_hash(mrs->_files[i].dh.filename);
+
+    _mrs_stems_count(mrs, mrs->_files[i].dh.filename, 1);
+    _mrs_names_add(mrs, i);
+    _mrs_bloom_add(mrs, h);
+
+    if((mrs->_index.used + 1) * 2 > mrs->_index.cap){
+        // It's among the files already, so the new index has it too
+        _mrs_index_rebuild(mrs, mrs->_hdr.dir_count);
+        return;
+    }
+
+    _mrs_index_put(&mrs->_index, h, i);
+}
+
+/**< Takes file `i` of `mrs` out of the index, for when its name is about to change. */
+void _mrs_index_remove(MRS* mrs, unsigned i){
+    struct mrs_index_t* x = &mrs->_index;
+    uint32_t h = _mrs_name_hash(mrs->_files[i].dh.filename);
+    size_t   s, e, home;
+
+    _mrs_stems_count(mrs, mrs->_files[i].dh.filename, -1);
+    _mrs_names_remove(mrs, i);
+    _mrs_bloom_remove(mrs, h);
+
+    if(!x->cap)
+        return;
+
+    s = h & (x->cap - 1);
+    while(x->slots[s].index && x->slots[s].index != i + 1)
+        s = (s + 1) & (x->cap - 1);
+    if(!x->slots[s].index)
+        return;
+
+    // Moves back whatever comes after it and would not be found anymore with the gap
+    for(e = (s + 1) & (x->cap - 1); x->slots[e].index; e = (e + 1) & (x->cap - 1)){
+        home = x->slots[e].hash & (x->cap - 1);
+        if(((e - home) & (x->cap - 1)) >= ((e - s) & (x->cap - 1))){
+            x->slots[s] = x->slots[e];
+            s = e;
+        }
+    }
+    x->slots[s].index = 0;
+    x->used--;
+}
+
+/**< Takes file `i` of `mrs` out of the index for good, the ones after it are about to move back one place. */
+void _mrs_index_forget(MRS* mrs, unsigned i){
+    size_t s;
+
+    _mrs_index_remove(mrs, i);
+    _mrs_names_shift(mrs, i);
+
+    for(s=0; s<mrs->_index.cap; s++){
+        if(mrs->_index.slots[s].index > i + 1)
+            mrs->_index.slots[s].index--;
+    }
+}
+
+/**< Index of the file named `s` in `mrs` (the first one, if there are more), `0` if there is none. */
+int _mrs_index_find(const MRS* mrs, const char* s, unsigned* index){
+    const struct mrs_index_t* x = &mrs->_index;
+    uint32_t h;
+    size_t   i;
+    unsigned found = 0;
+
+    h = _mrs_name_hash(s);
+
+    // Most names that aren't there are ruled out without going through the index
+    if(mrs->_bloom.bits && !_mrs_bloom_test(&mrs->_bloom, h))
+        return 0;
+
+    if(!x->cap){
+        for(i=0; i<mrs->_hdr.dir_count; i++){
+            if(_mrs_name_eq(s, mrs->_files[i].dh.filename)){
+                *index = i;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    for(i = h & (x->cap - 1); x->slots[i].index; i = (i + 1) & (x->cap - 1)){
+        if(x->slots[i].hash == h && (!found || x->slots[i].index < found) && _mrs_name_eq(s, mrs->_files[x->slots[i].index - 1].dh.filename))
+            found = x->slots[i].index;
+    }
+
+    if(!found)
+        return 0;
+
+    *index = found - 1;
+    return 1;
+}
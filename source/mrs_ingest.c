@@ -0,0 +1,338 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "mrs.h"
+#include "mrs_error.h"
+
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+       /// FROM mrs_util.c
+extern int _mrs_is_initialized(const MRS* mrs);
+       /// FROM mrs_add.c
+extern int _mrs_add_check(MRS* mrs, const char* name, enum mrs_dupe_behavior_t on_dupe, int check_name, int check_dup, char** final_name, unsigned* dup, unsigned* dup_index, int* isreplace);
+       /// FROM mrs_add.c
+extern int _mrs_add_file(MRS* mrs, const char* filename, char* final_name, void* reserved, enum mrs_dupe_behavior_t on_dupe, int pushit, struct mrs_file_t* f_out, int* isreplace, int* replaceindex);
+       /// FROM mrs_add.c
+extern int _mrs_add_packed(MRS* mrs, struct mrs_packed_t* p, char* final_name, const time_t* timep, enum mrs_dupe_behavior_t on_dupe, int check_dup, unsigned dup, unsigned dup_index, int pushit, struct mrs_file_t* f_out, int* replaceindex);
+       /// FROM mrs_compress.c
+extern int _mrs_pack(const MRS* mrs, const struct mrs_compression_t* c, const void* buffer, size_t buffer_size, const char* name, struct mrs_packed_t* p);
+       /// FROM mrs_compress.c
+extern void _mrs_codec_thread_cleanup();
+       /// FROM mrs_file.c
+extern int _mrs_files_append(struct mrs_files_t* f, const struct mrs_file_t* ff);
+       /// FROM mrs_file.c
+extern void _mrs_file_free(struct mrs_file_t* f);
+       /// FROM mrs_util.c
+extern void _mrs_temp_release(MRS* mrs, const struct mrs_file_t* f);
+       /// FROM mrs_replace_index.c
+extern void _mrs_replace_index_list_add(struct mrs_replace_index_list_t* il, unsigned oldi, unsigned newi);
+       /// FROM utils.c
+extern void _mrs_thread_cleanup();
+
+/**< Most threads `mrs_set_threads` takes */
+#define MRS_THREADS_MAX 64
+
+/**< How many jobs ahead of the calling thread each worker may be */
+#define MRS_INGEST_AHEAD 4
+
+#ifdef _WIN32
+typedef HANDLE    mrs_thread_t;
+#else
+typedef pthread_t mrs_thread_t;
+#endif
+
+static void _mrs_ingest_lock(struct mrs_ingest_t* in){
+#ifdef _WIN32
+    EnterCriticalSection(&in->lock);
+#else
+    pthread_mutex_lock(&in->lock);
+#endif
+}
+
+static void _mrs_ingest_unlock(struct mrs_ingest_t* in){
+#ifdef _WIN32
+    LeaveCriticalSection(&in->lock);
+#else
+    pthread_mutex_unlock(&in->lock);
+#endif
+}
+
+/**< Waits (with the lock held) until another thread calls `_mrs_ingest_wake`. */
+static void _mrs_ingest_wait(struct mrs_ingest_t* in){
+#ifdef _WIN32
+    SleepConditionVariableCS(&in->cond, &in->lock, INFINITE);
+#else
+    pthread_cond_wait(&in->cond, &in->lock);
+#endif
+}
+
+static void _mrs_ingest_wake(struct mrs_ingest_t* in){
+#ifdef _WIN32
+    WakeAllConditionVariable(&in->cond);
+#else
+    pthread_cond_broadcast(&in->cond);
+#endif
+}
+
+/**< Reads the file of `j` and packs it, the part of adding a file that doesn't touch the handle. */
+static void _mrs_ingest_run(const struct mrs_ingest_t* in, struct mrs_ingest_job_t* j){
+    unsigned char* buf;
+    struct stat    fs;
+    size_t         got = 0;
+    int            fd, r = 1;
+
+    fd = open(j->path, O_RDONLY | O_BINARY);
+    if(fd == -1){
+        dbgprintf("%s: File not found", j->path);
+        j->error = MRSE_NOT_FOUND;
+        return;
+    }
+
+    if(fstat(fd, &fs) != 0){
+        close(fd);
+        j->error = MRSE_CANNOT_OPEN;
+        return;
+    }
+    j->mtime = fs.st_mtime;
+
+    buf = (unsigned char*)malloc(fs.st_size ? fs.st_size : 1);
+    if(!buf){
+        close(fd);
+        j->error = MRSE_INSUFFICIENT_MEM;
+        return;
+    }
+
+    while(got < (size_t)fs.st_size && (r = read(fd, buf + got, fs.st_size - got)) > 0)
+        got += r;
+    close(fd);
+
+    j->error = r < 0 ? MRSE_CANNOT_OPEN : _mrs_pack(in->mrs, &in->mrs->_comp, buf, got, j->name, &j->packed);
+    free(buf);
+}
+
+static void _mrs_ingest_work(struct mrs_ingest_t* in){
+    size_t i;
+
+    _mrs_ingest_lock(in);
+    for(;;){
+        while(!in->stop && in->next < in->count && in->next >= in->committed + in->window)
+            _mrs_ingest_wait(in);
+        if(in->stop || in->next >= in->count)
+            break;
+        i = in->next++;
+
+        _mrs_ingest_unlock(in);
+        _mrs_ingest_run(in, &in->jobs[i]);
+        _mrs_ingest_lock(in);
+
+        in->jobs[i].done = 1;
+        _mrs_ingest_wake(in);
+    }
+    _mrs_ingest_unlock(in);
+
+    // The zlib streams (and whatever the backend keeps) of a worker are of no use once it's gone
+    _mrs_thread_cleanup();
+    _mrs_codec_thread_cleanup();
+}
+
+#ifdef _WIN32
+static DWORD WINAPI _mrs_ingest_worker(LPVOID param){
+#else
+static void* _mrs_ingest_worker(void* param){
+#endif
+    _mrs_ingest_work((struct mrs_ingest_t*)param);
+    return 0;
+}
+
+static int _mrs_thread_start(mrs_thread_t* t, struct mrs_ingest_t* in){
+#ifdef _WIN32
+    *t = CreateThread(NULL, 0, _mrs_ingest_worker, in, 0, NULL);
+    return *t != NULL;
+#else
+    return !pthread_create(t, NULL, _mrs_ingest_worker, in);
+#endif
+}
+
+static void _mrs_thread_join(mrs_thread_t t){
+#ifdef _WIN32
+    WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+#else
+    pthread_join(t, NULL);
+#endif
+}
+
+/**< Adds the file packed by job `j` to `files` as `_mrs_add_file` would have. */
+static int _mrs_ingest_commit(MRS* mrs, struct mrs_ingest_job_t* j, enum mrs_dupe_behavior_t on_dupe,
+                              struct mrs_files_t* files, struct mrs_replace_index_list_t* ridxl){
+    struct mrs_file_t f;
+    char*    final_name;
+    unsigned dup, dup_index;
+    int      isreplace, ridx, e;
+
+    e = _mrs_add_check(mrs, j->name, on_dupe, 1, 1, &final_name, &dup, &dup_index, &isreplace);
+    if(e != MRSE_OK)
+        return e;
+
+    if(j->error != MRSE_OK){
+        free(final_name);
+        return j->error;
+    }
+
+    e = _mrs_add_packed(mrs, &j->packed, final_name, &j->mtime, on_dupe, 1, dup, dup_index, 0, &f, &ridx);
+    if(e != MRSE_OK)
+        return e;
+
+    if(!_mrs_files_append(files, &f)){
+        _mrs_temp_release(mrs, &f);
+        _mrs_file_free(&f);
+        return MRSE_INSUFFICIENT_MEM;
+    }
+    if(on_dupe == MRSDB_KEEP_NEW && isreplace)
+        _mrs_replace_index_list_add(ridxl, ridx, ridxl->cnt);
+
+    return MRSE_OK;
+}
+
+/**< Packs the files of `jobs` on `threads` workers, taking each one back in order as soon as it's ready. */
+static int _mrs_add_paths_parallel(MRS* mrs, struct mrs_ingest_job_t* jobs, size_t count, unsigned threads,
+                                   enum mrs_dupe_behavior_t on_dupe, struct mrs_files_t* files, struct mrs_replace_index_list_t* ridxl){
+    struct mrs_ingest_t in;
+    mrs_thread_t*       t;
+    unsigned            started;
+    size_t              i;
+    int                 e = MRSE_OK;
+
+    t = (mrs_thread_t*)malloc(threads * sizeof(mrs_thread_t));
+    if(!t)
+        return MRSE_INSUFFICIENT_MEM;
+
+    memset(&in, 0, sizeof(struct mrs_ingest_t));
+    in.jobs    = jobs;
+    in.count   = count;
+    in.window  = (size_t)threads * MRS_INGEST_AHEAD;
+    in.mrs     = mrs;
+#ifdef _WIN32
+    InitializeCriticalSection(&in.lock);
+    InitializeConditionVariable(&in.cond);
+#else
+    pthread_mutex_init(&in.lock, NULL);
+    pthread_cond_init(&in.cond, NULL);
+#endif
+
+    for(started=0; started<threads && _mrs_thread_start(&t[started], &in); started++);
+    dbgprintf("%u worker(s) packing %u file(s)", started, count);
+
+    // Without workers, the calling thread packs every file itself
+    if(!started)
+        in.next = count;
+
+    for(i=0; i<count && e == MRSE_OK; i++){
+        _mrs_ingest_lock(&in);
+        while(started && !jobs[i].done)
+            _mrs_ingest_wait(&in);
+        _mrs_ingest_unlock(&in);
+
+        if(!jobs[i].done)
+            _mrs_ingest_run(&in, &jobs[i]);
+
+        e = _mrs_ingest_commit(mrs, &jobs[i], on_dupe, files, ridxl);
+
+        _mrs_ingest_lock(&in);
+        in.committed = i + 1;
+        _mrs_ingest_wake(&in);
+        _mrs_ingest_unlock(&in);
+    }
+
+    _mrs_ingest_lock(&in);
+    in.stop = 1;
+    _mrs_ingest_wake(&in);
+    _mrs_ingest_unlock(&in);
+
+    while(started)
+        _mrs_thread_join(t[--started]);
+    free(t);
+
+    // Whatever was packed after an error is not going anywhere
+    for(i=0; i<count; i++){
+        free(jobs[i].packed.buf);
+        jobs[i].packed.buf = NULL;
+    }
+
+#ifdef _WIN32
+    DeleteCriticalSection(&in.lock);
+#else
+    pthread_cond_destroy(&in.cond);
+    pthread_mutex_destroy(&in.lock);
+#endif
+
+    return e;
+}
+
+/**
+ * Adds the files of `jobs` (path and name of each) to `files` without pushing them, as `_mrs_add_folder` does,
+ * with `isreplace` ones listed in `ridxl`. Packing them is spread over `mrs->_threads` workers if more than one.
+ * Files are taken back in the order of `jobs` either way, so the result is the same as adding them one by one.
+ */
+int _mrs_add_paths(MRS* mrs, struct mrs_ingest_job_t* jobs, size_t count, void* reserved, enum mrs_dupe_behavior_t on_dupe,
+                   struct mrs_files_t* files, struct mrs_replace_index_list_t* ridxl){
+    struct mrs_file_t f;
+    size_t i;
+    int    isreplace, ridx, e;
+
+    if(mrs->_threads > 1 && count > 1)
+        return _mrs_add_paths_parallel(mrs, jobs, count, mrs->_threads < count ? mrs->_threads : (unsigned)count, on_dupe, files, ridxl);
+
+    for(i=0; i<count; i++){
+        isreplace = 0;
+        e = _mrs_add_file(mrs, jobs[i].path, (char*)jobs[i].name, reserved, on_dupe, 0, &f, on_dupe == MRSDB_KEEP_NEW ? &isreplace : NULL, on_dupe == MRSDB_KEEP_NEW ? &ridx : NULL);
+        if(e)
+            return e;
+        if(!_mrs_files_append(files, &f)){
+            _mrs_temp_release(mrs, &f);
+            _mrs_file_free(&f);
+            return MRSE_INSUFFICIENT_MEM;
+        }
+        if(on_dupe == MRSDB_KEEP_NEW && isreplace)
+            _mrs_replace_index_list_add(ridxl, ridx, ridxl->cnt);
+    }
+
+    return MRSE_OK;
+}
+
+int mrs_set_threads(MRS* mrs, unsigned threads){
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(threads > MRS_THREADS_MAX)
+        return MRSE_INVALID_PARAM;
+
+    dbgprintf("Setting threads to %u", threads);
+    mrs->_threads = threads;
+
+    return MRSE_OK;
+}
@@ -0,0 +1,278 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mrs.h"
+#include "mrs_error.h"
+
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+       /// FROM mrs_util.c
+extern int _mrs_is_initialized(const MRS* mrs);
+       /// FROM mrs_util.c
+extern void _mrs_lock(const MRS* mrs);
+       /// FROM mrs_util.c
+extern void _mrs_unlock(const MRS* mrs);
+       /// FROM mrs_index.c
+extern int _mrs_name_cmp(const char* a, const char* b, size_t n);
+
+/**< Order of files `a` and `b` of `mrs`: by name, then by index. */
+static int _mrs_names_cmp(const MRS* mrs, unsigned a, unsigned b){
+    int c;
+
+    c = _mrs_name_cmp(mrs->_files[a].dh.filename, mrs->_files[b].dh.filename, (size_t)-1);
+    if(c)
+        return c;
+
+    return a < b ? -1 : a > b;
+}
+
+/**< Merges `a[0, h)` and `a[h, n)`, both in order already, `tmp` has room for `h` indices. */
+static void _mrs_names_merge(const MRS* mrs, unsigned* a, unsigned* tmp, size_t h, size_t n){
+    size_t i = 0, j = h, k = 0;
+
+    if(!h || h == n || _mrs_names_cmp(mrs, a[h - 1], a[h]) < 0)
+        return;
+
+    memcpy(tmp, a, h * sizeof(unsigned));
+    while(i < h && j < n)
+        a[k++] = _mrs_names_cmp(mrs, tmp[i], a[j]) < 0 ? tmp[i++] : a[j++];
+    while(i < h)
+        a[k++] = tmp[i++];
+}
+
+static void _mrs_names_msort(const MRS* mrs, unsigned* a, unsigned* tmp, size_t n){
+    if(n < 2)
+        return;
+
+    _mrs_names_msort(mrs, a, tmp, n / 2);
+    _mrs_names_msort(mrs, a + n / 2, tmp, n - n / 2);
+    _mrs_names_merge(mrs, a, tmp, n / 2, n);
+}
+
+static void _mrs_names_drop(MRS* mrs){
+    dbgprintf("No memory for the name order, it will be made again when needed");
+
+    free(mrs->_names.order);
+    mrs->_names.order  = NULL;
+    mrs->_names.count  = 0;
+    mrs->_names.sorted = 0;
+    mrs->_names.cap    = 0;
+    mrs->_names.stale  = 1;
+}
+
+/**< Adds file `i` of `mrs` to the name order, it is put in its place the next time the order is needed. */
+void _mrs_names_add(MRS* mrs, unsigned i){
+    struct mrs_names_t* n = &mrs->_names;
+    unsigned* order;
+    size_t    cap;
+
+    if(n->stale)
+        return;
+
+    if(n->count == n->cap){
+        cap   = n->cap ? n->cap * 2 : 64;
+        order = (unsigned*)realloc(n->order, cap * sizeof(unsigned));
+        if(!order){
+            _mrs_names_drop(mrs);
+            return;
+        }
+        n->order = order;
+        n->cap   = cap;
+    }
+
+    n->order[n->count++] = i;
+}
+
+/**< Takes file `i` of `mrs` out of the name order, for when its name is about to change. */
+void _mrs_names_remove(MRS* mrs, unsigned i){
+    struct mrs_names_t* n = &mrs->_names;
+    size_t lo = 0, hi = n->sorted, mid, pos = n->count;
+    int    c;
+
+    if(n->stale)
+        return;
+
+    while(lo < hi){
+        mid = (lo + hi) / 2;
+        c   = _mrs_names_cmp(mrs, n->order[mid], i);
+        if(!c){
+            pos = mid;
+            break;
+        }
+        if(c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if(pos == n->count){
+        for(pos = n->sorted; pos < n->count && n->order[pos] != i; pos++);
+        if(pos == n->count)
+            return;
+    }
+
+    memmove(n->order + pos, n->order + pos + 1, (n->count - pos - 1) * sizeof(unsigned));
+    n->count--;
+    if(pos < n->sorted)
+        n->sorted--;
+}
+
+/**< Files after `i` of `mrs` are about to move back one place. */
+void _mrs_names_shift(MRS* mrs, unsigned i){
+    size_t s;
+
+    for(s=0; s<mrs->_names.count; s++){
+        if(mrs->_names.order[s] > i)
+            mrs->_names.order[s]--;
+    }
+}
+
+void _mrs_names_free(MRS* mrs){
+    free(mrs->_names.order);
+    memset(&mrs->_names, 0, sizeof(struct mrs_names_t));
+}
+
+/**< Puts the files added since last time in their place, `0` if out of memory. */
+static int _mrs_names_sort(MRS* mrs){
+    struct mrs_names_t* n = &mrs->_names;
+    unsigned* tmp;
+    unsigned  i;
+
+    if(n->stale){
+        n->order = (unsigned*)malloc((mrs->_hdr.dir_count ? mrs->_hdr.dir_count : 1) * sizeof(unsigned));
+        if(!n->order)
+            return 0;
+        for(i=0; i<mrs->_hdr.dir_count; i++)
+            n->order[i] = i;
+        n->count  = mrs->_hdr.dir_count;
+        n->cap    = n->count;
+        n->sorted = 0;
+        n->stale  = 0;
+    }
+
+    if(n->sorted == n->count)
+        return 1;
+
+    tmp = (unsigned*)malloc(n->count * sizeof(unsigned));
+    if(!tmp)
+        return 0;
+
+    dbgprintf("Sorting %u new name(s) into %u", n->count - n->sorted, n->sorted);
+
+    _mrs_names_msort(mrs, n->order + n->sorted, tmp, n->count - n->sorted);
+    _mrs_names_merge(mrs, n->order, tmp, n->sorted, n->count);
+    n->sorted = n->count;
+
+    free(tmp);
+
+    return 1;
+}
+
+/**< Makes sure `mrs->_names` is in order before it's read, even through a `const` handle, `0` if out of memory. */
+int _mrs_names_ready(const MRS* mrs){
+    int r;
+
+    _mrs_lock(mrs);
+    r = _mrs_names_sort((MRS*)mrs);
+    _mrs_unlock(mrs);
+
+    return r;
+}
+
+/**< First place in the name order of `mrs` whose name, up to `len` characters, is not less than `s` (`upper` = `0`) or is greater than `s` (`upper` = `1`). */
+size_t _mrs_names_bound(const MRS* mrs, const char* s, size_t len, int upper){
+    size_t lo = 0, hi = mrs->_names.count, mid;
+    int    c;
+
+    while(lo < hi){
+        mid = (lo + hi) / 2;
+        c   = _mrs_name_cmp(mrs->_files[mrs->_names.order[mid]].dh.filename, s, len);
+        if(c < 0 || (upper && !c))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**< Gives `sink` the files of `mrs` whose name starts with `prefix`, skipping the ones in subfolders if not `recursive`. */
+static int _mrs_list(const MRS* mrs, const char* prefix, int recursive, MRS_LIST_FUNC sink, void* param){
+    const char* name;
+    const char* p;
+    size_t      len, i, end;
+
+    if(!_mrs_names_ready(mrs))
+        return MRSE_INSUFFICIENT_MEM;
+
+    len = strlen(prefix);
+    i   = _mrs_names_bound(mrs, prefix, len, 0);
+    end = _mrs_names_bound(mrs, prefix, len, 1);
+
+    dbgprintf("%u file(s) start with \"%s\"", end - i, prefix);
+
+    while(i < end){
+        name = mrs->_files[mrs->_names.order[i]].dh.filename;
+
+        if(!recursive){
+            for(p = name + len; *p && *p != '/' && *p != '\\'; p++);
+            if(*p){
+                // Everything in that subfolder is right after it, so it's all skipped at once
+                i = _mrs_names_bound(mrs, name, p - name + 1, 1);
+                continue;
+            }
+        }
+
+        if(sink(mrs->_names.order[i], name, param))
+            break;
+        i++;
+    }
+
+    return MRSE_OK;
+}
+
+int mrs_list_prefix(const MRS* mrs, const char* prefix, MRS_LIST_FUNC sink, void* param){
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(!sink)
+        return MRSE_INVALID_PARAM;
+
+    return _mrs_list(mrs, prefix ? prefix : "", 1, sink, param);
+}
+
+int mrs_list_dir(const MRS* mrs, const char* dir, int recursive, MRS_LIST_FUNC sink, void* param){
+    char*  prefix;
+    size_t len;
+    int    r;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(!sink)
+        return MRSE_INVALID_PARAM;
+
+    len = dir ? strlen(dir) : 0;
+    if(!len || dir[len - 1] == '/' || dir[len - 1] == '\\')
+        return _mrs_list(mrs, len ? dir : "", recursive, sink, param);
+
+    // "dir" and "dir/" are the same folder, but "dir" alone would match "dir2/" too
+    prefix = (char*)malloc(len + 2);
+    if(!prefix)
+        return MRSE_INSUFFICIENT_MEM;
+    sprintf(prefix, "%s/", dir);
+
+    r = _mrs_list(mrs, prefix, recursive, sink, param);
+    free(prefix);
+
+    return r;
+}
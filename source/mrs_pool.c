@@ -0,0 +1,65 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+void _mrs_pool_init(struct mrs_pool_t* p){
+    p->blocks = NULL;
+}
+
+/**< Makes sure the current block has room for `size` more bytes, so they end up next to each other. */
+int _mrs_pool_reserve(struct mrs_pool_t* p, size_t size){
+    struct mrs_pool_block_t* b;
+
+    if(p->blocks && p->blocks->size - p->blocks->used >= size)
+        return 1;
+
+    if(size < MRS_POOL_BLOCK)
+        size = MRS_POOL_BLOCK;
+
+    b = (struct mrs_pool_block_t*)malloc(sizeof(struct mrs_pool_block_t) + size);
+    if(!b)
+        return 0;
+
+    dbgprintf("New pool block of %u bytes", size);
+
+    b->next   = p->blocks;
+    b->size   = size;
+    b->used   = 0;
+    p->blocks = b;
+
+    return 1;
+}
+
+/**< `size` bytes that stay valid until `_mrs_pool_free`, `NULL` if out of memory. */
+char* _mrs_pool_alloc(struct mrs_pool_t* p, size_t size){
+    char* s;
+
+    if(!_mrs_pool_reserve(p, size))
+        return NULL;
+
+    s = (char*)(p->blocks + 1) + p->blocks->used;
+    p->blocks->used += size;
+
+    return s;
+}
+
+void _mrs_pool_free(struct mrs_pool_t* p){
+    struct mrs_pool_block_t* b;
+
+    while(p->blocks){
+        b = p->blocks;
+        p->blocks = b->next;
+        free(b);
+    }
+}
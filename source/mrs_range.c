@@ -0,0 +1,226 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mrs.h"
+#include "mrs_error.h"
+#include "zlib.h"
+
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+       /// FROM mrs_util.c
+extern int _mrs_is_initialized(const MRS* mrs);
+       /// FROM mrs_util.c
+extern void _mrs_lock(const MRS* mrs);
+       /// FROM mrs_util.c
+extern void _mrs_unlock(const MRS* mrs);
+       /// FROM mrs_util.c
+extern int _mrs_file_read_at(const MRS* mrs, struct mrs_file_t* f, unsigned char* buf, size_t pos, size_t size);
+       /// FROM utils.c
+extern z_stream* _mrs_inflater();
+       /// FROM mrs_source.c
+extern int _mrs_file_resolve(const MRS* mrs, struct mrs_file_t* f);
+
+/**< Last checkpoint of `idx` at or before `offset`, `NULL` if inflating has to start from the beginning. */
+static const struct mrs_zpoint_t* _mrs_zindex_find(const struct mrs_zindex_t* idx, size_t offset){
+    size_t lo = 0, hi, mid;
+
+    if(!idx || !idx->count || idx->points[0].out > offset)
+        return NULL;
+
+    hi = idx->count;
+    while(hi - lo > 1){
+        mid = (lo + hi) / 2;
+        if(idx->points[mid].out <= offset)
+            lo = mid;
+        else
+            hi = mid;
+    }
+
+    return &idx->points[lo];
+}
+
+/**< Saves a checkpoint at the current position of `z`, `win` is the circular window and `left` how much of it is free. */
+static int _mrs_zindex_add(struct mrs_zindex_t* idx, const z_stream* z, size_t in, size_t out, const unsigned char* win, size_t left){
+    struct mrs_zpoint_t* p;
+
+    p = (struct mrs_zpoint_t*)realloc(idx->points, sizeof(struct mrs_zpoint_t) * (idx->count + 1));
+    if(!p)
+        return 0;
+    idx->points = p;
+
+    p = &idx->points[idx->count];
+    p->out  = out;
+    p->in   = in;
+    p->bits = z->data_type & 7;
+    // Oldest bytes are the ones right after where the window is being written to
+    memcpy(p->window, win + MRS_ZINDEX_WINDOW - left, left);
+    memcpy(p->window + left, win, MRS_ZINDEX_WINDOW - left);
+
+    idx->count++;
+
+    dbgprintf("Checkpoint %u: uncompressed %u, compressed %u (+%d bits)", idx->count, out, in, p->bits);
+
+    return 1;
+}
+
+/**
+ * Inflates `f` from the closest checkpoint before `offset`, copying `[offset, offset+len)` to `buf`.
+ * If the inflating goes past the last checkpoint, new ones are saved along the way.
+ */
+static int _mrs_inflate_range(const MRS* mrs, struct mrs_file_t* f, size_t offset, size_t len, unsigned char* buf){
+    const struct mrs_zpoint_t* p;
+    z_stream*      z;
+    unsigned char* in;
+    unsigned char* win;
+    unsigned char  c;
+    size_t         cpos = 0, out = 0, last, produced, from, to, end = offset + len;
+    unsigned       before;
+    int            bits = 0, r, e = MRSE_OK;
+
+    in  = (unsigned char*)malloc(MRS_ENTRY_WINDOW);
+    win = (unsigned char*)calloc(1, MRS_ZINDEX_WINDOW);
+    if(!in || !win){
+        free(in);
+        free(win);
+        return MRSE_INSUFFICIENT_MEM;
+    }
+
+    z = _mrs_inflater();
+    if(!z){
+        free(in);
+        free(win);
+        return MRSE_CANNOT_UNCOMPRESS;
+    }
+
+    // Other threads may be reading (and adding checkpoints) too, so the checkpoint is copied out
+    _mrs_lock(mrs);
+    if(!f->zidx && f->dh.h.uncompressed_size > MRS_ZINDEX_SPAN){
+        f->zidx = (struct mrs_zindex_t*)calloc(1, sizeof(struct mrs_zindex_t));
+        dbgprintf("Building checkpoints for a %u bytes file", f->dh.h.uncompressed_size);
+    }
+    p = _mrs_zindex_find(f->zidx, offset);
+    if(p){
+        dbgprintf("Starting from checkpoint at %u (asked for %u)", p->out, offset);
+        cpos = p->in;
+        out  = p->out;
+        bits = p->bits;
+        memcpy(win, p->window, MRS_ZINDEX_WINDOW);
+    }
+    last = f->zidx && f->zidx->count ? f->zidx->points[f->zidx->count - 1].out : 0;
+    _mrs_unlock(mrs);
+
+    if(out){
+        if(bits){
+            if(!_mrs_file_read_at(mrs, f, &c, cpos - 1, 1)){
+                e = MRSE_CANNOT_OPEN;
+                goto done;
+            }
+            inflatePrime(z, bits, c >> (8 - bits));
+        }
+        inflateSetDictionary(z, win, MRS_ZINDEX_WINDOW);
+    }
+
+    z->avail_out = 0;
+    while(out < end){
+        if(!z->avail_out){
+            z->next_out  = win;
+            z->avail_out = MRS_ZINDEX_WINDOW;
+        }
+        if(!z->avail_in){
+            if(cpos >= f->dh.h.compressed_size){
+                e = MRSE_CANNOT_UNCOMPRESS;
+                break;
+            }
+            z->avail_in = f->dh.h.compressed_size - cpos > MRS_ENTRY_WINDOW ? MRS_ENTRY_WINDOW : f->dh.h.compressed_size - cpos;
+            if(!_mrs_file_read_at(mrs, f, in, cpos, z->avail_in)){
+                e = MRSE_CANNOT_OPEN;
+                break;
+            }
+            cpos       += z->avail_in;
+            z->next_in  = in;
+        }
+
+        before = z->avail_out;
+        r = inflate(z, Z_BLOCK);
+        if(r != Z_OK && r != Z_STREAM_END){
+            dbgprintf("Inflating failed (%d) at uncompressed %u", r, out);
+            e = MRSE_CANNOT_UNCOMPRESS;
+            break;
+        }
+
+        produced = before - z->avail_out;
+        from = out > offset ? out : offset;
+        to   = out + produced < end ? out + produced : end;
+        if(from < to)
+            memcpy(buf + (from - offset), z->next_out - produced + (from - out), to - from);
+        out += produced;
+
+        if(r == Z_STREAM_END)
+            break;
+
+        // End of a block that isn't the last one, a good place for a checkpoint
+        if(f->zidx && (z->data_type & 128) && !(z->data_type & 64) && out > last && out - last > MRS_ZINDEX_SPAN){
+            _mrs_lock(mrs);
+            last = f->zidx->count ? f->zidx->points[f->zidx->count - 1].out : 0;
+            if(out > last && out - last > MRS_ZINDEX_SPAN && _mrs_zindex_add(f->zidx, z, cpos - z->avail_in, out, win, z->avail_out))
+                last = out;
+            _mrs_unlock(mrs);
+        }
+    }
+
+    if(e == MRSE_OK && out < end && out < f->dh.h.uncompressed_size)
+        e = MRSE_CANNOT_UNCOMPRESS;
+
+done:
+    free(in);
+    free(win);
+
+    return e;
+}
+
+int mrs_read_range(const MRS* mrs, unsigned index, size_t offset, size_t len, unsigned char* buf, size_t* out_size){
+    struct mrs_file_t* f;
+    int r;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    if(index >= mrs->_hdr.dir_count)
+        return MRSE_INVALID_INDEX;
+
+    f = &mrs->_files[index];
+
+    if(offset > f->dh.h.uncompressed_size || (!buf && len))
+        return MRSE_INVALID_PARAM;
+
+    if(!_mrs_file_resolve(mrs, f))
+        return MRSE_INVALID_ENCRYPTION;
+
+    if(len > f->dh.h.uncompressed_size - offset)
+        len = f->dh.h.uncompressed_size - offset;
+
+    if(out_size)
+        *out_size = len;
+
+    if(!len)
+        return MRSE_OK;
+
+    if(f->dh.h.compression == MRSCM_STORE)
+        return _mrs_file_read_at(mrs, f, buf, offset, len) ? MRSE_OK : MRSE_CANNOT_OPEN;
+
+    r = _mrs_inflate_range(mrs, f, offset, len, buf);
+    if(r != MRSE_OK && out_size)
+        *out_size = 0;
+
+    return r;
+}
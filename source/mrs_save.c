@@ -8,6 +8,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <io.h>
 #include <windows.h>
 #include <Shlwapi.h>
 
@@ -21,6 +24,26 @@
  extern int _strbkslash(char* s, size_t size);
         /// FROM utils.c
  extern int _mkdirs(const char* s);
+        /// FROM mrs_util.c
+ extern int _mrs_file_read(const MRS* mrs, struct mrs_file_t* f, unsigned char* buf);
+        /// FROM mrs_source.c
+extern unsigned _mrs_source_find(const MRS* mrs, const char* name);
+       /// FROM mrs_source.c
+extern int _mrs_file_resolve(const MRS* mrs, struct mrs_file_t* f);
+        /// FROM mrs_source.c
+ extern int _mrs_source_detach(MRS* mrs, unsigned src);
+        /// FROM mrs_source.c
+ extern int _mrs_source_read(const MRS* mrs, unsigned src, unsigned char* buf, off_t offset, size_t size);
+        /// FROM mrs_source.c
+extern void _mrs_source_ref(MRS* mrs, unsigned src);
+        /// FROM mrs_source.c
+extern void _mrs_source_release(MRS* mrs, unsigned src);
+        /// FROM mrs_cache.c
+extern void _mrs_cache_drop(MRS* mrs, const struct mrs_file_t* f);
+        /// FROM mrs_util.c
+extern void _mrs_temp_release(MRS* mrs, const struct mrs_file_t* f);
+        /// FROM mrs_compact.c
+extern void _mrs_compact_auto(MRS* mrs);
 #ifdef _LIBMRS_DBG
         /// FROM utils.c
 extern void _hex_dump(const unsigned char* buf, size_t size);
@@ -34,115 +57,117 @@ extern void mrs_central_dir_hdr_dump(const struct mrs_central_dir_hdr_t* h);
 int _mrs_save_mrs(const MRS* mrs, FILE* f, MRS_PROGRESS_FUNC pcallback);
 
 #define MRS_SAVE_CALLBACK(...) if(pcallback) pcallback(__VA_ARGS__);
-int _mrs_save_mrs_fname(const MRS* mrs, const char* output, MRS_PROGRESS_FUNC pcallback){
-    char real_output[256];
-    FILE* f;
-    int e;
-    
-    GetFullPathNameA(output, 256, real_output, NULL);
 
-    if((PathFileExistsA(real_output) && PathIsDirectoryA(real_output)) || _is_valid_output_filename(real_output))
-        return MRSE_INVALID_FILENAME;
-    
-    f = fopen(real_output, "wb");
-    if(!f)
-        return MRSE_CANNOT_SAVE;
-    
-    e = _mrs_save_mrs(mrs, f, pcallback);
-
-    fclose(f);
-    
-    return e;
+/**< Routines the archive is encrypted with when saved. */
+static void _mrs_save_encryption(const MRS* mrs, struct mrs_encryption_t* encrypt){
+    encrypt->base_hdr  = mrs->_enc.base_hdr ? mrs->_enc.base_hdr : mrs_default_encrypt;
+    encrypt->local_hdr = mrs->_enc.local_hdr ? mrs->_enc.local_hdr : encrypt->base_hdr;
+    encrypt->central_dir_hdr = mrs->_enc.central_dir_hdr ? mrs->_enc.central_dir_hdr : encrypt->base_hdr;
+    encrypt->buffer = mrs->_enc.buffer;
 }
 
-int _mrs_save_mrs(const MRS* mrs, FILE* f, MRS_PROGRESS_FUNC pcallback){
-    // FILE* f;
-    struct mrs_hdr_t hdr;
-    // char real_output[256];
-    struct mrs_file_t* fil;
-    unsigned char* temp;
-    unsigned i, j;
-    struct mrs_encryption_t encrypt;
-    double p;
-
-    dbgprintf("Ok let's save this as a MRS file.");
-
-    ///TODO: Make it portable
-    // GetFullPathNameA(output, 256, real_output, NULL);
-
-    // if((PathFileExistsA(real_output) && PathIsDirectoryA(real_output)) || _is_valid_output_filename(real_output))
-    //     return MRSE_INVALID_FILENAME;
-
-    encrypt.base_hdr  = mrs->_enc.base_hdr ? mrs->_enc.base_hdr : mrs_default_encrypt;
-    encrypt.local_hdr = mrs->_enc.local_hdr ? mrs->_enc.local_hdr : encrypt.base_hdr;
-    encrypt.central_dir_hdr = mrs->_enc.central_dir_hdr ? mrs->_enc.central_dir_hdr : encrypt.base_hdr;
-    encrypt.buffer = mrs->_enc.buffer;
-        
-    memcpy(&hdr, &mrs->_hdr, sizeof(struct mrs_hdr_t));
-    
-    dbgprintf("We got %u files", hdr.dir_count);
-    // f = fopen(real_output, "wb");
-    // if(!f)
-    //     return MRSE_CANNOT_SAVE;
+/**< Local header of `f`, with its name and extra, as it is written to the archive (`size` bytes), `NULL` if out of memory. */
+static unsigned char* _mrs_save_local_hdr(const MRS* mrs, const struct mrs_encryption_t* encrypt, const struct mrs_file_t* f, size_t* size){
+    struct mrs_local_hdr_t lh;
+    unsigned char* buf;
+    unsigned char* name;
+
+    *size = sizeof(struct mrs_local_hdr_t) + f->lh.h.filename_length + f->lh.h.extra_length;
+    buf = (unsigned char*)malloc(*size);
+    if(!buf)
+        return NULL;
+
+    memcpy(&lh, &f->lh.h, sizeof(struct mrs_local_hdr_t));
+    if(mrs->_sigs[1])
+        lh.signature = mrs->_sigs[1];
+    encrypt->local_hdr((unsigned char*)&lh, sizeof(struct mrs_local_hdr_t));
+    _hex_dump((unsigned char*)&lh, sizeof(struct mrs_local_hdr_t));
+    memcpy(buf, &lh, sizeof(struct mrs_local_hdr_t));
+
+    name = buf + sizeof(struct mrs_local_hdr_t);
+    memcpy(name, f->lh.filename, f->lh.h.filename_length);
+    _strbkslash((char*)name, f->lh.h.filename_length);
+    encrypt->local_hdr(name, f->lh.h.filename_length);
+
+    if(f->lh.h.extra_length){
+        memcpy(name + f->lh.h.filename_length, f->lh.extra, f->lh.h.extra_length);
+        encrypt->local_hdr(name + f->lh.h.filename_length, f->lh.h.extra_length);
+    }
 
-    fil = (struct mrs_file_t*)malloc(sizeof(struct mrs_file_t) * hdr.dir_count);
-    memcpy(fil, mrs->_files, sizeof(struct mrs_file_t) * hdr.dir_count);
+    return buf;
+}
 
-    hdr.dir_size = 0;
+/**< Bytes of the file buffer of `f` in the archive. */
+static size_t _mrs_save_buffer_size(const struct mrs_file_t* f){
+    return f->lh.h.uncompressed_size ? f->lh.h.compressed_size : 0;
+}
 
-    p = 0;
-    for(i=0; i<hdr.dir_count; i++){
-        p = (double)i / (double)hdr.dir_count;
-        MRS_SAVE_CALLBACK(p, i+1, mrs->_hdr.dir_count, MRSP_BEGIN, mrs->_files[i].dh.filename);
+/**< Writes the local header of `f` and its (encrypted) file buffer to `fp`, where `fil` (its copy) says it starts. */
+static int _mrs_save_file(const MRS* mrs, const struct mrs_encryption_t* encrypt, struct mrs_file_t* f, struct mrs_file_t* fil, FILE* fp){
+    unsigned char* temp;
+    size_t         size;
 
-        dbgprintf("%u/%u", i+1, hdr.dir_count);
-        if(mrs->_sigs[1])
-            fil[i].lh.h.signature = mrs->_sigs[1];
-        
-        // Here we write the local header
-        encrypt.local_hdr((unsigned char*)&fil[i].lh.h, sizeof(struct mrs_local_hdr_t));
-        _hex_dump((unsigned char*)&fil[i].lh.h, sizeof(struct mrs_local_hdr_t));
-        fil[i].dh.h.offset = ftell(f);
-        fwrite((unsigned char*)&fil[i].lh.h, sizeof(struct mrs_local_hdr_t), 1, f);
-		dbgprintf("Encrypt local header\n");
-
-        // Here we write the filename
-        temp = (unsigned char*)malloc(mrs->_files[i].lh.h.filename_length);
-        memcpy(temp, fil[i].lh.filename, mrs->_files[i].lh.h.filename_length);
-        _strbkslash(temp, mrs->_files[i].lh.h.filename_length);
-        encrypt.local_hdr(temp, mrs->_files[i].lh.h.filename_length);
-        fwrite(temp, mrs->_files[i].lh.h.filename_length, 1, f);
+    temp = _mrs_save_local_hdr(mrs, encrypt, f, &size);
+    if(!temp)
+        return MRSE_INSUFFICIENT_MEM;
+    fil->dh.h.offset = ftell(fp);
+    if(fwrite(temp, size, 1, fp) != 1){
         free(temp);
-		dbgprintf("File name\n");
-
-        // Here we write extra, if any
-        if(mrs->_files[i].lh.h.extra_length){
-            temp = (unsigned char*)malloc(mrs->_files[i].lh.h.extra_length);
-            memcpy(temp, fil[i].lh.extra, mrs->_files[i].lh.h.extra_length);
-            encrypt.local_hdr(temp, mrs->_files[i].lh.h.extra_length);
-            fwrite(temp, mrs->_files[i].lh.h.extra_length, 1, f);
+        return MRSE_CANNOT_SAVE;
+    }
+    free(temp);
+
+    size = _mrs_save_buffer_size(f);
+    if(size){
+        temp = (unsigned char*)malloc(size);
+        if(!temp)
+            return MRSE_INSUFFICIENT_MEM;
+        if(!_mrs_file_read(mrs, f, temp)){
             free(temp);
+            return MRSE_CANNOT_OPEN;
         }
-
-        // And finally the file buffer
-        if(mrs->_files[i].lh.h.uncompressed_size){
-            temp = (unsigned char*)malloc(mrs->_files[i].lh.h.compressed_size);
-            _mrs_temp_read(mrs, temp, mrs->_files[i].dh.h.offset, mrs->_files[i].lh.h.compressed_size);
-            if(encrypt.buffer)
-                encrypt.buffer(temp, mrs->_files[i].lh.h.compressed_size);
-            fwrite(temp, mrs->_files[i].lh.h.compressed_size, 1, f);
+        if(encrypt->buffer)
+            encrypt->buffer(temp, size);
+        if(fwrite(temp, size, 1, fp) != 1){
             free(temp);
+            return MRSE_CANNOT_SAVE;
         }
+        free(temp);
+    }
 
-        MRS_SAVE_CALLBACK(p, i+1, mrs->_hdr.dir_count, MRSP_END, mrs->_files[i].dh.filename);
+    return MRSE_OK;
+}
 
-        hdr.dir_size += sizeof(struct mrs_central_dir_hdr_t) + fil[i].dh.h.filename_length + fil[i].dh.h.extra_length + fil[i].dh.h.comment_length;
-    }
+/**< Size of the central directory of `mrs` in the archive. */
+static size_t _mrs_save_central_dir_size(const MRS* mrs){
+    size_t   size = 0;
+    unsigned i;
 
-    temp = (unsigned char*)malloc(hdr.dir_size);
+    for(i=0; i<mrs->_hdr.dir_count; i++)
+        size += sizeof(struct mrs_central_dir_hdr_t) + mrs->_files[i].dh.h.filename_length + mrs->_files[i].dh.h.extra_length + mrs->_files[i].dh.h.comment_length;
+
+    return size;
+}
+
+/**
+ * Central directory of `fil` (the files of `mrs`, with their offsets in the archive) followed by the base header, as
+ * written at `offset` of the archive (`size` bytes), `NULL` if out of memory.
+ */
+static unsigned char* _mrs_save_central_dir_buf(const MRS* mrs, const struct mrs_encryption_t* encrypt, struct mrs_file_t* fil, size_t offset,
+                                                size_t* size){
+    struct mrs_hdr_t hdr;
+    unsigned char* temp;
+    unsigned i, j;
+
+    memcpy(&hdr, &mrs->_hdr, sizeof(struct mrs_hdr_t));
+    hdr.dir_size = _mrs_save_central_dir_size(mrs);
+
+    temp = (unsigned char*)malloc(hdr.dir_size + sizeof(struct mrs_hdr_t));
+    if(!temp)
+        return NULL;
     j = 0;
 
-    hdr.dir_offset = ftell(f);
+    hdr.dir_offset = offset;
     for(i=0; i<hdr.dir_count; i++){
         dbgprintf("%s dump", fil[i].dh.filename);
         mrs_central_dir_hdr_dump(&fil[i].dh);
@@ -168,16 +193,302 @@ int _mrs_save_mrs(const MRS* mrs, FILE* f, MRS_PROGRESS_FUNC pcallback){
         }
     }
 
-    free(fil);
+    encrypt->central_dir_hdr(temp, hdr.dir_size);
 
-    encrypt.central_dir_hdr(temp, hdr.dir_size);
-    fwrite(temp, hdr.dir_size, 1, f);
+    hdr.signature = mrs->_sigs[0] ? mrs->_sigs[0] : MRSM_MAGIC2;
+
+    encrypt->base_hdr((unsigned char*)&hdr, sizeof(struct mrs_hdr_t));
+    memcpy(temp + j, &hdr, sizeof(struct mrs_hdr_t));
+    *size = j + sizeof(struct mrs_hdr_t);
+
+    return temp;
+}
+
+/**< Writes the central directory of `fil` (the files of `mrs`, with their offsets in the archive) and the base header to `fp`. */
+static int _mrs_save_central_dir(const MRS* mrs, const struct mrs_encryption_t* encrypt, struct mrs_file_t* fil, FILE* fp){
+    unsigned char* temp;
+    size_t size;
+    int e = MRSE_OK;
+
+    temp = _mrs_save_central_dir_buf(mrs, encrypt, fil, ftell(fp), &size);
+    if(!temp)
+        return MRSE_INSUFFICIENT_MEM;
+
+    if(fwrite(temp, size, 1, fp) != 1)
+        e = MRSE_CANNOT_SAVE;
     free(temp);
 
-    hdr.signature = mrs->_sigs[0] ? mrs->_sigs[0] : MRSM_MAGIC2;
+    return e;
+}
+
+/**< `1` if the local header of `f` (`lh`, `size` bytes) is right before its buffer in source `src` already. */
+static int _mrs_save_in_place(const MRS* mrs, unsigned src, const struct mrs_file_t* f, const unsigned char* lh, size_t size){
+    unsigned char* temp;
+    int r;
+
+    if(f->src != src || f->dh.h.offset < size)
+        return 0;
+
+    temp = (unsigned char*)malloc(size);
+    if(!temp)
+        return 0;
 
-    encrypt.base_hdr((unsigned char*)&hdr, sizeof(struct mrs_hdr_t));
-    fwrite((unsigned char*)&hdr, sizeof(struct mrs_hdr_t), 1, f);
+    r = _mrs_source_read(mrs, src, temp, f->dh.h.offset - size, size) && !memcmp(temp, lh, size);
+    free(temp);
+
+    return r;
+}
+
+/**< `1` if `fp` (`size` bytes) ends with the central directory of `fil` and the base header already, `tail` bytes. */
+static int _mrs_save_tail_same(const MRS* mrs, const struct mrs_encryption_t* encrypt, struct mrs_file_t* fil, FILE* fp, size_t size,
+                               size_t tail){
+    unsigned char* buf;
+    unsigned char* cur;
+    size_t n;
+    int r;
+
+    if(size < tail)
+        return 0;
+
+    buf = _mrs_save_central_dir_buf(mrs, encrypt, fil, size - tail, &n);
+    cur = (unsigned char*)malloc(tail);
+    r   = buf && cur && n == tail && !fseek(fp, size - tail, SEEK_SET) && fread(cur, tail, 1, fp) == 1 && !memcmp(buf, cur, tail);
+    free(buf);
+    free(cur);
+
+    return r;
+}
+
+/**
+ * Saves `mrs` over `output`, which is its source `src`, leaving the files still read from there where they are:
+ * the other files are written after the end of the archive, then the central directory and the base header. Nothing
+ * of the archive is overwritten, so it's cut back to what it was if that fails. Sets `rewrite` (writing nothing) if
+ * the whole archive has to be written instead, see `mrs_set_incremental_threshold`.
+ */
+static int _mrs_save_mrs_incremental(MRS* mrs, const char* output, unsigned src, MRS_PROGRESS_FUNC pcallback, int* rewrite){
+    struct mrs_encryption_t encrypt;
+    struct mrs_source_t* cur = &mrs->_srcs.srcs[src-1];
+    struct mrs_file_t* f;
+    struct mrs_file_t* fil;
+    unsigned char* kept;
+    unsigned char* lh;
+    size_t size, end = 0, add = 0, live, tail, total, old;
+    unsigned i, n = mrs->_hdr.dir_count;
+    double p;
+    FILE* fp;
+    int e = MRSE_OK;
+
+    *rewrite = 1;
+    _mrs_save_encryption(mrs, &encrypt);
+
+    // File buffers left where they are were encrypted by whoever wrote the archive
+    if(!encrypt.buffer != !cur->dec)
+        return MRSE_OK;
+
+    for(i=0; i<n; i++){
+        if(!_mrs_file_resolve(mrs, &mrs->_files[i]))
+            return MRSE_INVALID_ENCRYPTION;
+    }
+
+    kept = (unsigned char*)calloc(n ? n : 1, 1);
+    if(!kept)
+        return MRSE_INSUFFICIENT_MEM;
+
+    // A file stays only if a full save would write the very same local header right there
+    tail = _mrs_save_central_dir_size(mrs) + sizeof(struct mrs_hdr_t);
+    live = tail;
+    for(i=0; i<n; i++){
+        f  = &mrs->_files[i];
+        lh = _mrs_save_local_hdr(mrs, &encrypt, f, &size);
+        if(!lh){
+            free(kept);
+            return MRSE_INSUFFICIENT_MEM;
+        }
+        kept[i] = _mrs_save_in_place(mrs, src, f, lh, size);
+        free(lh);
+
+        size += _mrs_save_buffer_size(f);
+        live += size;
+        if(!kept[i])
+            add += size;
+        else if(f->dh.h.offset + f->dh.h.compressed_size > end)
+            end = f->dh.h.offset + f->dh.h.compressed_size;
+    }
+
+    fil = (struct mrs_file_t*)malloc(sizeof(struct mrs_file_t) * (n ? n : 1));
+    fp  = fopen(output, "r+b");
+    if(!fil || !fp){
+        if(fp)
+            fclose(fp);
+        free(fil);
+        free(kept);
+        return fil ? MRSE_CANNOT_SAVE : MRSE_INSUFFICIENT_MEM;
+    }
+    memcpy(fil, mrs->_files, sizeof(struct mrs_file_t) * n);
+
+    // Everything goes after the end of the archive (mapped, it may be past what the source knows of), nothing there
+    // is overwritten. The base header is looked for at the end of the file though, so until the new one is written
+    // the archive can't be opened: an error cuts it back below, a crash leaves it to be cut back to `old` bytes
+    fseek(fp, 0, SEEK_END);
+    old = ftell(fp);
+    total = old + add + tail;
+
+    dbgprintf("Incremental save: %u bytes kept, %u bytes to write, %u of %u bytes dead", end, add, total - live, total);
+    if(!end || (unsigned long long)(total - live) * 100 > (unsigned long long)total * mrs->_inc_threshold){
+        fclose(fp);
+        free(fil);
+        free(kept);
+        return MRSE_OK;
+    }
+    *rewrite = 0;
+
+    for(i=0; i<n; i++){
+        f = &mrs->_files[i];
+        if(kept[i])
+            fil[i].dh.h.offset = f->dh.h.offset - (sizeof(struct mrs_local_hdr_t) + f->lh.h.filename_length + f->lh.h.extra_length);
+    }
+
+    // With every file left in place, nothing is written if the archive ends with the same central directory already
+    if(!add && _mrs_save_tail_same(mrs, &encrypt, fil, fp, old, tail)){
+        dbgprintf("Incremental save: nothing changed");
+        fclose(fp);
+        free(fil);
+        free(kept);
+        MRS_SAVE_CALLBACK(1.f, n, n, MRSP_DONE, NULL);
+        return MRSE_OK;
+    }
+
+    fseek(fp, old, SEEK_SET);
+    for(i=0; i<n && e == MRSE_OK; i++){
+        f = &mrs->_files[i];
+        p = (double)i / (double)n;
+        MRS_SAVE_CALLBACK(p, i+1, n, MRSP_BEGIN, f->dh.filename);
+
+        if(!kept[i])
+            e = _mrs_save_file(mrs, &encrypt, f, &fil[i], fp);
+
+        MRS_SAVE_CALLBACK(p, i+1, n, e ? MRSP_ERROR : MRSP_END, e ? (void*)(intptr_t)e : f->dh.filename);
+    }
+
+    if(e == MRSE_OK)
+        e = _mrs_save_central_dir(mrs, &encrypt, fil, fp);
+    if(fflush(fp) && e == MRSE_OK)
+        e = MRSE_CANNOT_SAVE;
+    // Only what was written after the archive goes, it's the archive it was again
+    if(e != MRSE_OK)
+        _chsize_s(_fileno(fp), (__int64)old);
+    if(fclose(fp) && e == MRSE_OK)
+        e = MRSE_CANNOT_SAVE;
+
+    // Files just written are read from the archive from now on, so the next save leaves them there too.
+    // Not if it's mapped: the mapping can't grow (views of it may be out), so they stay where they were
+    // and the next save writes them again
+    if(e == MRSE_OK && !cur->map){
+        cur->size = total;
+        for(i=0; i<n; i++){
+            f = &mrs->_files[i];
+            if(kept[i])
+                continue;
+            _mrs_cache_drop(mrs, f);
+            if(f->src)
+                _mrs_source_release(mrs, f->src);
+            else
+                _mrs_temp_release(mrs, f);
+            f->src = src;
+            f->dh.h.offset = fil[i].dh.h.offset + sizeof(struct mrs_local_hdr_t) + f->lh.h.filename_length + f->lh.h.extra_length;
+            _mrs_source_ref(mrs, src);
+        }
+        // Their copies in the temporary storage are of no use anymore
+        _mrs_compact_auto(mrs);
+    }
+
+    free(fil);
+    free(kept);
+
+    if(e == MRSE_OK)
+        MRS_SAVE_CALLBACK(1.f, n, n, MRSP_DONE, NULL);
+
+    return e;
+}
+
+int _mrs_save_mrs_fname(MRS* mrs, const char* output, int incremental, MRS_PROGRESS_FUNC pcallback){
+    char real_output[256];
+    FILE* f;
+    unsigned src;
+    int e, rewrite;
+    
+    GetFullPathNameA(output, 256, real_output, NULL);
+
+    if((PathFileExistsA(real_output) && PathIsDirectoryA(real_output)) || _is_valid_output_filename(real_output))
+        return MRSE_INVALID_FILENAME;
+
+    src = _mrs_source_find(mrs, real_output);
+    if(src && incremental){
+        e = _mrs_save_mrs_incremental(mrs, real_output, src, pcallback, &rewrite);
+        if(e || !rewrite)
+            return e;
+        dbgprintf("Writing the whole archive instead");
+    }
+
+    // We are about to overwrite an archive we still read files from, so they have to be copied first
+    if(src){
+        dbgprintf("Output is source %u, copying its files to the temporary storage", src);
+        e = _mrs_source_detach(mrs, src);
+        if(e)
+            return e;
+    }
+    
+    f = fopen(real_output, "wb");
+    if(!f)
+        return MRSE_CANNOT_SAVE;
+    
+    e = _mrs_save_mrs(mrs, f, pcallback);
+
+    fclose(f);
+    
+    return e;
+}
+
+int _mrs_save_mrs(const MRS* mrs, FILE* f, MRS_PROGRESS_FUNC pcallback){
+    struct mrs_file_t* fil;
+    unsigned i;
+    struct mrs_encryption_t encrypt;
+    double p;
+    int e = MRSE_OK;
+
+    dbgprintf("Ok let's save this as a MRS file.");
+
+    _mrs_save_encryption(mrs, &encrypt);
+
+    dbgprintf("We got %u files", mrs->_hdr.dir_count);
+
+    // Local headers not read yet are needed now
+    for(i=0; i<mrs->_hdr.dir_count; i++){
+        if(!_mrs_file_resolve(mrs, &mrs->_files[i]))
+            return MRSE_INVALID_ENCRYPTION;
+    }
+
+    fil = (struct mrs_file_t*)malloc(sizeof(struct mrs_file_t) * (mrs->_hdr.dir_count ? mrs->_hdr.dir_count : 1));
+    if(!fil)
+        return MRSE_INSUFFICIENT_MEM;
+    memcpy(fil, mrs->_files, sizeof(struct mrs_file_t) * mrs->_hdr.dir_count);
+
+    p = 0;
+    for(i=0; i<mrs->_hdr.dir_count && e == MRSE_OK; i++){
+        p = (double)i / (double)mrs->_hdr.dir_count;
+        MRS_SAVE_CALLBACK(p, i+1, mrs->_hdr.dir_count, MRSP_BEGIN, mrs->_files[i].dh.filename);
+
+        dbgprintf("%u/%u", i+1, mrs->_hdr.dir_count);
+        e = _mrs_save_file(mrs, &encrypt, &mrs->_files[i], &fil[i], f);
+
+        MRS_SAVE_CALLBACK(p, i+1, mrs->_hdr.dir_count, MRSP_END, mrs->_files[i].dh.filename);
+    }
+
+    if(e == MRSE_OK)
+        e = _mrs_save_central_dir(mrs, &encrypt, fil, f);
+    free(fil);
+    if(e)
+        return e;
 
     MRS_SAVE_CALLBACK(1.f, mrs->_hdr.dir_count, mrs->_hdr.dir_count, MRSP_DONE, NULL);
 
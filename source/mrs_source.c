@@ -0,0 +1,416 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <windows.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "mrs.h"
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+       /// FROM mrs_util.c
+extern off_t _mrs_temp_tell(MRS* mrs);
+       /// FROM mrs_util.c
+extern int _mrs_temp_write(MRS* mrs, unsigned char* buf, size_t size);
+       /// FROM mrs_cache.c
+extern void _mrs_cache_drop_source(MRS* mrs, unsigned src);
+       /// FROM mrs_util.c
+extern int _mrs_pread(FILE* fp, unsigned char* buf, off_t offset, size_t size);
+       /// FROM mrs_util.c
+extern void _mrs_lock(const MRS* mrs);
+       /// FROM mrs_util.c
+extern void _mrs_unlock(const MRS* mrs);
+       /// FROM mrs_util.c
+extern long _mrs_file_flags(const struct mrs_file_t* f);
+       /// FROM mrs_util.c
+extern void _mrs_file_clear_flags(struct mrs_file_t* f, long flags);
+       /// FROM mrs_ref_table.c
+extern unsigned char* _mrs_ref_table_append(struct mrs_ref_table_t* r, const unsigned char* s, size_t len);
+
+void _mrs_source_list_init(struct mrs_source_list_t* l){
+    l->srcs  = NULL;
+    l->count = 0;
+}
+
+/**< Maps the whole file `name` read-only, returns `NULL` if it can't (or if the file is empty). */
+static const unsigned char* _mrs_map_file(const char* name, size_t* size){
+#ifdef _WIN32
+    HANDLE         f;
+    HANDLE         m;
+    LARGE_INTEGER  fsize;
+    void*          view;
+
+    f = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(f == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    if(!GetFileSizeEx(f, &fsize) || !fsize.QuadPart || (unsigned long long)fsize.QuadPart > (size_t)-1){
+        CloseHandle(f);
+        return NULL;
+    }
+
+    m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(f);
+    if(!m)
+        return NULL;
+
+    // The view keeps the mapping (and the file) alive, so both handles can go
+    view = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(m);
+    if(!view)
+        return NULL;
+
+    *size = (size_t)fsize.QuadPart;
+    return (const unsigned char*)view;
+#else
+    int         fd;
+    struct stat fs;
+    void*       view;
+
+    fd = open(name, O_RDONLY);
+    if(fd == -1)
+        return NULL;
+
+    if(fstat(fd, &fs) != 0 || !fs.st_size){
+        close(fd);
+        return NULL;
+    }
+
+    view = mmap(NULL, fs.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(view == MAP_FAILED)
+        return NULL;
+
+    *size = fs.st_size;
+    return (const unsigned char*)view;
+#endif
+}
+
+static void _mrs_unmap_file(const unsigned char* map, size_t size){
+#ifdef _WIN32
+    UnmapViewOfFile(map);
+#else
+    munmap((void*)map, size);
+#endif
+}
+
+/**< Closes the archive of `cur` and marks its slot as not in use. */
+static void _mrs_source_close(struct mrs_source_t* cur){
+    if(cur->map && !cur->borrowed)
+        _mrs_unmap_file(cur->map, cur->size);
+    if(cur->fp)
+        fclose(cur->fp);
+    free(cur->name);
+    memset(cur, 0, sizeof(struct mrs_source_t));
+}
+
+/**< One-based index of a slot of `l` that is not in use, adding one if there is none, `0` if out of memory. */
+static unsigned _mrs_source_slot(struct mrs_source_list_t* l){
+    struct mrs_source_t* srcs;
+    unsigned i;
+
+    for(i=0; i<l->count; i++){
+        if(!l->srcs[i].ref)
+            break;
+    }
+
+    if(i == l->count){
+        srcs = (struct mrs_source_t*)realloc(l->srcs, sizeof(struct mrs_source_t) * (l->count + 1));
+        if(!srcs)
+            return 0;
+        l->srcs = srcs;
+        memset(&l->srcs[i], 0, sizeof(struct mrs_source_t));
+        l->count++;
+    }
+
+    return i+1;
+}
+
+/**< Opens `name` as a source of `mrs`, `src` receives its one-based index. */
+int _mrs_source_open(MRS* mrs, const char* name, MRS_ENCRYPTION_FUNC dec, MRS_ENCRYPTION_FUNC lhdec, int map, unsigned* src){
+    struct mrs_source_list_t* l = &mrs->_srcs;
+    struct mrs_source_t* cur;
+    char     full_name[256];
+    char*    sname;
+    FILE*    fp = NULL;
+    const unsigned char* view = NULL;
+    size_t   size = 0;
+    unsigned i;
+
+    if(map){
+        view = _mrs_map_file(name, &size);
+        dbgprintf("Mapping \"%s\": %s", name, view ? "ok" : "failed, let's just read it then");
+    }
+
+    if(!view){
+        fp = fopen(name, "rb");
+        if(!fp)
+            return MRSE_NOT_FOUND;
+        fseek(fp, 0, SEEK_END);
+        size = ftell(fp);
+    }
+
+    GetFullPathNameA(name, 256, full_name, NULL);
+
+    sname = strdup(full_name);
+    i     = sname ? _mrs_source_slot(l) : 0;
+    if(!i){
+        free(sname);
+        if(view)
+            _mrs_unmap_file(view, size);
+        if(fp)
+            fclose(fp);
+        return MRSE_INSUFFICIENT_MEM;
+    }
+    cur = &l->srcs[--i];
+    cur->name = sname;
+    cur->fp   = fp;
+    cur->map  = view;
+    cur->size = size;
+    cur->dec   = dec;
+    cur->lhdec = lhdec;
+    cur->ref   = 1;
+
+    dbgprintf("Opened \"%s\" as source %u", cur->name, i+1);
+
+    *src = i+1;
+
+    return MRSE_OK;
+}
+
+/**< Uses `buf` (owned by the caller) as a source of `mrs`, `src` receives its one-based index. */
+int _mrs_source_open_memory(MRS* mrs, const unsigned char* buf, size_t size, MRS_ENCRYPTION_FUNC dec, MRS_ENCRYPTION_FUNC lhdec, unsigned* src){
+    struct mrs_source_list_t* l = &mrs->_srcs;
+    struct mrs_source_t* cur;
+    unsigned i;
+
+    i = _mrs_source_slot(l);
+    if(!i)
+        return MRSE_INSUFFICIENT_MEM;
+    cur = &l->srcs[--i];
+    cur->name     = NULL;
+    cur->fp       = NULL;
+    cur->map      = buf;
+    cur->borrowed = 1;
+    cur->size     = size;
+    cur->dec      = dec;
+    cur->lhdec    = lhdec;
+    cur->ref      = 1;
+
+    dbgprintf("Opened %u bytes of memory as source %u", size, i+1);
+
+    *src = i+1;
+
+    return MRSE_OK;
+}
+
+/**< Index of the source opened from `name`, or `0` if there is none. */
+unsigned _mrs_source_find(const MRS* mrs, const char* name){
+    char     full_name[256];
+    unsigned i;
+
+    GetFullPathNameA(name, 256, full_name, NULL);
+
+    for(i=0; i<mrs->_srcs.count; i++){
+        if(mrs->_srcs.srcs[i].ref && mrs->_srcs.srcs[i].name && !stricmp(mrs->_srcs.srcs[i].name, full_name))
+            return i+1;
+    }
+
+    return 0;
+}
+
+/**< Reads `size` bytes at `offset` of source `src`, as they are in the archive. */
+int _mrs_source_read(const MRS* mrs, unsigned src, unsigned char* buf, off_t offset, size_t size){
+    struct mrs_source_t* cur;
+
+    if(!src || src > mrs->_srcs.count)
+        return 0;
+
+    cur = &mrs->_srcs.srcs[src-1];
+    if(!cur->ref || (size_t)offset > cur->size || size > cur->size - offset)
+        return 0;
+
+    if(cur->map){
+        memcpy(buf, cur->map + offset, size);
+        return 1;
+    }
+
+    return _mrs_pread(cur->fp, buf, offset, size);
+}
+
+void _mrs_source_ref(MRS* mrs, unsigned src){
+    if(!src || src > mrs->_srcs.count)
+        return;
+    mrs->_srcs.srcs[src-1].ref++;
+}
+
+/**
+ * Reads the local header of `f` if it wasn't yet (see `MRSF_TRUST_CDIR`), so `dh.h.offset` is where its buffer is.
+ * Returns `0` if the local header is not valid.
+ */
+int _mrs_file_resolve(const MRS* mrs, struct mrs_file_t* f){
+    struct mrs_source_t*   cur;
+    struct mrs_local_hdr_t lh;
+    unsigned char*         extra = NULL;
+    MRS*                   self;
+    int r = 0;
+
+    if(!(_mrs_file_flags(f) & MRSFF_LH_PENDING))
+        return 1;
+
+    _mrs_lock(mrs);
+    // What is read lazily is kept through the handle itself, only while locked
+    self = (MRS*)mrs->_ptr;
+
+    // Someone else may have done it while we waited
+    if(!(_mrs_file_flags(f) & MRSFF_LH_PENDING)){
+        _mrs_unlock(mrs);
+        return 1;
+    }
+
+    if(!f->src || f->src > mrs->_srcs.count)
+        goto end;
+    cur = &mrs->_srcs.srcs[f->src-1];
+
+    if(!_mrs_source_read(mrs, f->src, (unsigned char*)&lh, f->dh.h.offset, sizeof(struct mrs_local_hdr_t)))
+        goto end;
+    cur->lhdec((unsigned char*)&lh, sizeof(struct mrs_local_hdr_t));
+
+    if(!mrs_default_signatures(MRSSW_LOCAL_HDR, lh.signature) && (!mrs->_sig || !mrs->_sig(MRSSW_LOCAL_HDR, lh.signature))){
+        dbgprintf("Invalid local header @ %08x", f->dh.h.offset);
+        goto end;
+    }
+
+    if(lh.extra_length){
+        extra = (unsigned char*)malloc(lh.extra_length);
+        if(!extra || !_mrs_source_read(mrs, f->src, extra, f->dh.h.offset + sizeof(struct mrs_local_hdr_t) + lh.filename_length, lh.extra_length))
+            goto end;
+        cur->lhdec(extra, lh.extra_length);
+        f->lh.extra = (char*)_mrs_ref_table_append(&self->_reftable, extra, lh.extra_length);
+    }
+
+    dbgprintf("Local header @ %08x read, file buffer is %u bytes after it", f->dh.h.offset, sizeof(struct mrs_local_hdr_t) + lh.filename_length + lh.extra_length);
+
+    f->dh.h.offset += sizeof(struct mrs_local_hdr_t) + lh.filename_length + lh.extra_length;
+    // The file name is the one of the central dir header, as for files read right away
+    lh.filename_length = f->lh.h.filename_length;
+    memcpy(&f->lh.h, &lh, sizeof(struct mrs_local_hdr_t));
+    _mrs_file_clear_flags(f, MRSFF_LH_PENDING);
+    r = 1;
+
+end:
+    free(extra);
+    _mrs_unlock(mrs);
+
+    return r;
+}
+
+/**< Drops a reference to source `src`, the archive is closed once nobody uses it anymore. */
+void _mrs_source_release(MRS* mrs, unsigned src){
+    struct mrs_source_t* cur;
+
+    if(!src || src > mrs->_srcs.count)
+        return;
+
+    cur = &mrs->_srcs.srcs[src-1];
+    if(!cur->ref)
+        return;
+
+    if(--cur->ref)
+        return;
+
+    dbgprintf("No more files from source %u, closing \"%s\"", src, cur->name);
+    _mrs_cache_drop_source(mrs, src);
+    _mrs_source_close(cur);
+}
+
+/**< Copies the buffer of `f` from its source to the temporary storage. */
+int _mrs_source_detach_file(MRS* mrs, struct mrs_file_t* f){
+    unsigned char*      temp;
+    unsigned            src = f->src;
+    MRS_ENCRYPTION_FUNC dec;
+    off_t               offset;
+
+    if(!src || src > mrs->_srcs.count)
+        return MRSE_INVALID_PARAM;
+
+    dec = mrs->_srcs.srcs[src-1].dec;
+
+    if(!_mrs_file_resolve(mrs, f))
+        return MRSE_INVALID_ENCRYPTION;
+
+    temp = (unsigned char*)malloc(f->dh.h.compressed_size ? f->dh.h.compressed_size : 1);
+    if(!temp)
+        return MRSE_INSUFFICIENT_MEM;
+
+    // `f` stays read from its source unless its buffer made it to the temporary storage
+    if(!_mrs_source_read(mrs, src, temp, f->dh.h.offset, f->dh.h.compressed_size)){
+        free(temp);
+        return MRSE_CANNOT_OPEN;
+    }
+    if(dec)
+        dec(temp, f->dh.h.compressed_size);
+
+    offset = _mrs_temp_tell(mrs);
+    if(!_mrs_temp_write(mrs, temp, f->dh.h.compressed_size)){
+        free(temp);
+        return MRSE_INSUFFICIENT_MEM;
+    }
+    free(temp);
+
+    f->dh.h.offset = offset;
+    f->src = 0;
+    _mrs_source_release(mrs, src);
+
+    return MRSE_OK;
+}
+
+/**< Copies every file still read from source `src` to the temporary storage, so the archive can go away. */
+int _mrs_source_detach(MRS* mrs, unsigned src){
+    unsigned i;
+    int      e;
+
+    if(!src || src > mrs->_srcs.count)
+        return MRSE_INVALID_PARAM;
+
+    for(i=0; i<mrs->_hdr.dir_count; i++){
+        if(mrs->_files[i].src != src)
+            continue;
+
+        e = _mrs_source_detach_file(mrs, &mrs->_files[i]);
+        if(e)
+            return e;
+    }
+
+    return MRSE_OK;
+}
+
+void _mrs_source_free_all(struct mrs_source_list_t* l){
+    unsigned i;
+
+    for(i=0; i<l->count; i++){
+        if(l->srcs[i].ref){
+            dbgprintf("Closing source \"%s\"", l->srcs[i].name);
+            _mrs_source_close(&l->srcs[i]);
+        }
+    }
+
+    free(l->srcs);
+    l->srcs  = NULL;
+    l->count = 0;
+}
@@ -11,6 +11,13 @@
 #include <stdlib.h>
 #include <sys/types.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
 #include "dostime.h"
 #include "mrs.h"
 #include "mrs_internal.h"
@@ -18,8 +25,24 @@
 
        /// FROM mrs_file.c
 extern void _mrs_file_free(struct mrs_file_t* f);
-       /// FROM utils.c
-extern int _get_fnum(const char* s, unsigned* n, char** offset);
+       /// FROM mrs_source.c
+extern int _mrs_source_read(const MRS* mrs, unsigned src, unsigned char* buf, off_t offset, size_t size);
+       /// FROM mrs_source.c
+extern void _mrs_source_release(MRS* mrs, unsigned src);
+       /// FROM mrs_source.c
+extern int _mrs_file_resolve(const MRS* mrs, struct mrs_file_t* f);
+       /// FROM mrs_cache.c
+extern void _mrs_cache_drop(MRS* mrs, const struct mrs_file_t* f);
+       /// FROM mrs_index.c
+extern void _mrs_index_rebuild(MRS* mrs, size_t n);
+       /// FROM mrs_index.c
+extern void _mrs_index_add(MRS* mrs, unsigned i);
+       /// FROM mrs_index.c
+extern void _mrs_index_remove(MRS* mrs, unsigned i);
+       /// FROM mrs_index.c
+extern int _mrs_index_find(const MRS* mrs, const char* s, unsigned* i);
+       /// FROM mrs_index.c
+extern char* _mrs_name_next(const MRS* mrs, const char* s);
 
 /**< Checks if `mrs` is `NULL`. */
 int _mrs_is_initialized(const MRS* mrs){
@@ -28,164 +51,315 @@ int _mrs_is_initialized(const MRS* mrs){
   return 1;
 }
 
-/**< Checks if there is any item with the same name as `s` in `mrs`. */
+/**
+ * Checks if there is any item with the same name as `s` in `mrs`.
+ * If there is, `match_index` gets the first one and `s_out` a new name for `s` as `stem (N)ext`.
+ */
 int _mrs_is_duplicate(const MRS* mrs, const char* s, char** s_out, unsigned* match_index){
-  char* s_temp;
-  char  temp2[256];
-  char* temp;
-  char  my_ext[64];
-  unsigned my_num = 0;
-  unsigned num = 0;
-  unsigned e, i;
-  unsigned match = 0;
-  unsigned* n   = NULL;
-  size_t n_size = 0;
-  
-  s_temp = (char*)malloc(strlen(s)+1);
-  strcpy(s_temp, s);
-  
-  temp = strrchr(s_temp, '.');
-  if(temp){
-    strcpy(my_ext, temp);
-    *temp = 0;
-  }
-  
-  _get_fnum(s_temp, &my_num, &temp);
-  if(temp)
-    *temp = 0;
-  
-  dbgprintf("\"%s\"", s_temp);
-  dbgprintf("My extension: %s", my_ext);
-  dbgprintf("My num: %u", my_num);
-  
-  for(i=0; i<mrs->_hdr.dir_count; i++){
-    strcpy(temp2, mrs->_files[i].dh.filename);
-    dbgprintf("%s", temp2);
-    if(!stricmp(temp2, s) && !match){
-      match = 1;
-      if(match_index)
-        *match_index = i;
-      dbgprintf(" EXACT MATCH");
-    }
-    temp = strrchr(temp2, '.');
-    dbgprintf(" Extension: %s == %s?", temp, my_ext);
-    if((my_ext && !temp) || (!my_ext && temp) || (my_ext && temp && stricmp(my_ext, temp))) // Not same extension, skip it then...
-      continue;
-    dbgprintf("            OK");
-    
-    *temp = 0;
-    e = _get_fnum(temp2, &num, &temp);
-    if(!e){
-      *temp = 0;
-      dbgprintf(" Num: %u", num);
-    }
-    
-    dbgprintf("%s == %s?", temp2, s_temp);
-    if(!stricmp(s_temp, temp2)){
-      dbgprintf("%u", e);
-      if(e)
-        continue;
-      
-      dbgprintf("adding %u to the n list...", num);
-      
-      n = (unsigned*)realloc(n, sizeof(unsigned)*(n_size+1));
-      e = 0;
-      if(n_size){
-        for(e=0; e<n_size; e++){
-          if(num < n[e])
-            break;
-        }
-        memmove(n+e+1, n+e, sizeof(unsigned)*(n_size-e));
-      }
-      n[e] = num;
-      n_size++;
-    }
-  }
-  
-  if (match) {
-    if (match)
-        my_num = 2;
-    if (n) {
-        for (i = 0; i < n_size; i++) {
-            if (my_num < n[i])
-                break;
-            if (my_num == n[i])
-                my_num++;
-        }
-        free(n);
-    }
-    dbgprintf("My final num is: %u", my_num);
-    dbgprintf("%s (%u)%s", s_temp, my_num, my_ext ? my_ext : "");
-    if (s_out) {
-        sprintf(temp2, "%s (%u)%s", s_temp, my_num, my_ext ? my_ext : "");
-        *s_out = (char*)malloc(strlen(temp2) + 1);
-        strcpy(*s_out, temp2);
-    }
-  }
-  else {
-      free(s_temp);
-      return 1;
-  }
-  
-  free(s_temp);
-  dbgprintf("Freed");
-  
+  unsigned i;
+
+  if(!_mrs_index_find(mrs, s, &i))
+    return 1;
+
+  if(match_index)
+    *match_index = i;
+  if(s_out)
+    *s_out = _mrs_name_next(mrs, s);
+
+  dbgprintf("\"%s\" is a duplicate of file %u", s, i);
+
   return 0;
 }
 
-void _mrs_push_file(MRS* mrs, const struct mrs_file_t f){
+/**< Makes room for `n` files in total in `mrs`. */
+int _mrs_reserve_files(MRS* mrs, size_t n){
+    struct mrs_file_t* files;
+
+    if(n <= mrs->_files_cap)
+        return 1;
+
+    files = (struct mrs_file_t*)realloc(mrs->_files, n*sizeof(struct mrs_file_t));
+    if(!files)
+        return 0;
+
+    mrs->_files     = files;
+    mrs->_files_cap = n;
+
+    // The index is made as big as it will need to be, too
+    if(n * 2 > mrs->_index.cap)
+        _mrs_index_rebuild(mrs, n);
+
+    return 1;
+}
+
+/**< Returns 0 if there's no memory for one more file, leaving `mrs` as it was. */
+int _mrs_push_file(MRS* mrs, const struct mrs_file_t f){
     unsigned i = mrs->_hdr.dir_count;
-    mrs->_files = (struct mrs_file_t*)realloc(mrs->_files, (mrs->_hdr.dir_count + 1)*sizeof(struct mrs_file_t));
+
+    if(i == mrs->_files_cap && !_mrs_reserve_files(mrs, mrs->_files_cap ? mrs->_files_cap * 2 : 16))
+        return 0;
 
     memcpy(&mrs->_files[i], &f, sizeof(struct mrs_file_t));
 
     mrs->_hdr.dir_count++;
     mrs->_hdr.total_dir_count = mrs->_hdr.dir_count;
+
+    _mrs_index_add(mrs, i);
+
+    return 1;
+}
+
+void _mrs_lock_init(MRS* mrs){
+#ifdef _WIN32
+    InitializeCriticalSection(&mrs->_lock);
+#else
+    pthread_mutex_init(&mrs->_lock, NULL);
+#endif
+}
+
+/**< Locks the state of `mrs` that reading changes (cache, checkpoints, references), even through a `const` handle. */
+void _mrs_lock(const MRS* mrs){
+#ifdef _WIN32
+    EnterCriticalSection((CRITICAL_SECTION*)&mrs->_lock);
+#else
+    pthread_mutex_lock((pthread_mutex_t*)&mrs->_lock);
+#endif
+}
+
+void _mrs_unlock(const MRS* mrs){
+#ifdef _WIN32
+    LeaveCriticalSection((CRITICAL_SECTION*)&mrs->_lock);
+#else
+    pthread_mutex_unlock((pthread_mutex_t*)&mrs->_lock);
+#endif
+}
+
+void _mrs_lock_free(MRS* mrs){
+#ifdef _WIN32
+    DeleteCriticalSection(&mrs->_lock);
+#else
+    pthread_mutex_destroy(&mrs->_lock);
+#endif
+}
+
+/**< Flags of `f`, along with everything written to `f` before they last changed (even by another thread). */
+long _mrs_file_flags(const struct mrs_file_t* f){
+#ifdef _MSC_VER
+    return InterlockedOr((volatile LONG*)&f->flags, 0);
+#else
+    return __atomic_load_n(&f->flags, __ATOMIC_ACQUIRE);
+#endif
+}
+
+/**< Sets `flags` of `f` after everything written to `f` before. */
+void _mrs_file_set_flags(struct mrs_file_t* f, long flags){
+#ifdef _MSC_VER
+    InterlockedOr((volatile LONG*)&f->flags, flags);
+#else
+    __atomic_or_fetch(&f->flags, flags, __ATOMIC_RELEASE);
+#endif
+}
+
+/**< Clears `flags` of `f` after everything written to `f` before. */
+void _mrs_file_clear_flags(struct mrs_file_t* f, long flags){
+#ifdef _MSC_VER
+    InterlockedAnd((volatile LONG*)&f->flags, ~flags);
+#else
+    __atomic_and_fetch(&f->flags, ~flags, __ATOMIC_RELEASE);
+#endif
+}
+
+/**
+ * Reads `size` bytes at `offset` of `fp` without using its position, so many threads can read at once.
+ * On Windows the read does move the position of the handle (it isn't opened for overlapped I/O), which is fine
+ * only because nothing else relies on it: `_mrs_temp_write` seeks before every write.
+ */
+int _mrs_pread(FILE* fp, unsigned char* buf, off_t offset, size_t size){
+#ifdef _WIN32
+    OVERLAPPED ov;
+    DWORD      n;
+    HANDLE     h = (HANDLE)_get_osfhandle(_fileno(fp));
+
+    while(size){
+        memset(&ov, 0, sizeof(OVERLAPPED));
+        ov.Offset     = (DWORD)((unsigned long long)offset & 0xFFFFFFFF);
+        ov.OffsetHigh = (DWORD)((unsigned long long)offset >> 32);
+        if(!ReadFile(h, buf, size > 0x40000000 ? 0x40000000 : (DWORD)size, &n, &ov) || !n)
+            return 0;
+        buf    += n;
+        offset += n;
+        size   -= n;
+    }
+#else
+    ssize_t n;
+
+    while(size){
+        n = pread(fileno(fp), buf, size, offset);
+        if(n <= 0)
+            return 0;
+        buf    += n;
+        offset += n;
+        size   -= n;
+    }
+#endif
+    return 1;
 }
 
 off_t _mrs_temp_tell(MRS* mrs){
-    return (mrs->_mtype == MRSMT_TEMPFILE ? ftell(mrs->_fbuf) : mrs->_mbuf_size);
+    return mrs->_mbuf_size;
+}
+
+/**< Counts the buffer of `f` as dead space of the temporary storage, for when `f` stops using it. */
+void _mrs_temp_release(MRS* mrs, const struct mrs_file_t* f){
+    if(!f->src)
+        mrs->_mbuf_dead += f->dh.h.compressed_size;
 }
 
+/**< Appends `buf` to the temporary storage, returning 0 if it couldn't (its offset is `_mrs_temp_tell` before the call). */
 int _mrs_temp_write(MRS* mrs, unsigned char* buf, size_t size){
+    unsigned char* temp;
+    size_t         cap, n;
+
     if(mrs->_mtype == MRSMT_TEMPFILE){
         fseek(mrs->_fbuf, 0, SEEK_END);
         dbgprintf("Writing %u bytes to temporary file", size);
-        fwrite(buf, size, 1, mrs->_fbuf);
+        n = fwrite(buf, 1, size, mrs->_fbuf);
+        mrs->_mbuf_size += n;
+        // Reads go straight to the file, not through the FILE buffer
+        if(fflush(mrs->_fbuf) || n != size){
+            // Whatever made it to the file is of no one, the next write goes after it
+            mrs->_mbuf_dead += n;
+            return 0;
+        }
     }else{
         dbgprintf("Writing %u bytes to memory", size);
-        mrs->_mbuf = (unsigned char*)realloc(mrs->_mbuf, mrs->_mbuf_size + size);
+        if(mrs->_mbuf_size + size > mrs->_mbuf_cap){
+            cap = mrs->_mbuf_cap * 2;
+            if(cap < mrs->_mbuf_size + size)
+                cap = mrs->_mbuf_size + size;
+            temp = (unsigned char*)realloc(mrs->_mbuf, cap);
+            if(!temp)
+                return 0;
+            mrs->_mbuf     = temp;
+            mrs->_mbuf_cap = cap;
+        }
         memcpy(mrs->_mbuf + mrs->_mbuf_size, buf, size);
         mrs->_mbuf_size += size;
     }
     return 1;
 }
 
-int _mrs_temp_read(MRS* mrs, unsigned char* buf, off_t offset, size_t size){
-    off_t _off;
-    if(mrs->_mtype == MRSMT_TEMPFILE){
-        _off = ftell(mrs->_fbuf);
-        if(offset >= _off)
-            return 0;
-        fseek(mrs->_fbuf, offset, SEEK_SET);
-        fread(buf, size, 1, mrs->_fbuf);
-        fseek(mrs->_fbuf, 0, SEEK_END);
+/**< Moves the temporary storage of `mrs` to a temporary file or to memory (`MRSMT_*`), along with what it has. */
+int _mrs_temp_set_type(MRS* mrs, int type){
+    unsigned char* buf;
+    FILE*          fp;
+
+    if(mrs->_mtype == type)
+        return MRSE_OK;
+
+    if(type == MRSMT_MEMORY){
+        buf = (unsigned char*)malloc(mrs->_mbuf_size ? mrs->_mbuf_size : 1);
+        if(!buf)
+            return MRSE_INSUFFICIENT_MEM;
+        if(mrs->_mbuf_size && !_mrs_pread(mrs->_fbuf, buf, 0, mrs->_mbuf_size)){
+            free(buf);
+            return MRSE_CANNOT_OPEN;
+        }
+        fclose(mrs->_fbuf);
+        mrs->_mbuf     = buf;
+        mrs->_mbuf_cap = mrs->_mbuf_size ? mrs->_mbuf_size : 1;
+        dbgprintf("Temporary storage moved to memory (%u bytes)", mrs->_mbuf_size);
     }else{
-        if(offset >= mrs->_mbuf_size)
-            return 0;
-        memcpy(buf, mrs->_mbuf + offset, size);
+        fp = tmpfile();
+        if(!fp)
+            return MRSE_CANNOT_OPEN;
+        if((mrs->_mbuf_size && fwrite(mrs->_mbuf, mrs->_mbuf_size, 1, fp) != 1) || fflush(fp)){
+            fclose(fp);
+            return MRSE_CANNOT_OPEN;
+        }
+        free(mrs->_mbuf);
+        mrs->_fbuf     = fp;
+        mrs->_mbuf_cap = 0;
+        dbgprintf("Temporary storage moved to a temporary file (%u bytes)", mrs->_mbuf_size);
     }
+
+    mrs->_mtype = type;
+
+    return MRSE_OK;
+}
+
+int _mrs_temp_read(const MRS* mrs, unsigned char* buf, off_t offset, size_t size){
+    if((size_t)offset > mrs->_mbuf_size || size > mrs->_mbuf_size - offset)
+        return 0;
+    if(mrs->_mtype == MRSMT_TEMPFILE)
+        return _mrs_pread(mrs->_fbuf, buf, offset, size);
+    memcpy(buf, mrs->_mbuf + offset, size);
     return 1;
 }
 
+/**
+ * Reads `size` bytes at `pos` of the (decrypted) compressed buffer of `f`, wherever it is stored.
+ * Decrypting a piece on its own is only right if the decryption works byte by byte, as `mrs_default_decrypt` does.
+ */
+int _mrs_file_read_at(const MRS* mrs, struct mrs_file_t* f, unsigned char* buf, size_t pos, size_t size){
+    MRS_ENCRYPTION_FUNC dec;
+
+    if(pos > f->dh.h.compressed_size || size > f->dh.h.compressed_size - pos)
+        return 0;
+
+    if(!_mrs_file_resolve(mrs, f))
+        return 0;
+
+    if(!f->src)
+        return _mrs_temp_read(mrs, buf, f->dh.h.offset + pos, size);
+
+    if(!_mrs_source_read(mrs, f->src, buf, f->dh.h.offset + pos, size))
+        return 0;
+
+    dec = mrs->_srcs.srcs[f->src-1].dec;
+    if(dec)
+        dec(buf, size);
+
+    return 1;
+}
+
+/**< Reads the (decrypted) compressed buffer of `f`, wherever it is stored. */
+int _mrs_file_read(const MRS* mrs, struct mrs_file_t* f, unsigned char* buf){
+    return _mrs_file_read_at(mrs, f, buf, 0, f->dh.h.compressed_size);
+}
+
+/**< Pointer to the compressed buffer of `f` right where it is stored, or `NULL` if it has to be read with `_mrs_file_read`. */
+const unsigned char* _mrs_file_ptr(const MRS* mrs, struct mrs_file_t* f){
+    const struct mrs_source_t* s;
+
+    if(!f->src){
+        if(mrs->_mtype != MRSMT_MEMORY || f->dh.h.offset > mrs->_mbuf_size || f->dh.h.compressed_size > mrs->_mbuf_size - f->dh.h.offset)
+            return NULL;
+        return mrs->_mbuf + f->dh.h.offset;
+    }
+
+    s = &mrs->_srcs.srcs[f->src-1];
+    if(!s->map || s->dec || !_mrs_file_resolve(mrs, f))
+        return NULL;
+    if(f->dh.h.offset > s->size || f->dh.h.compressed_size > s->size - f->dh.h.offset)
+        return NULL;
+
+    return s->map + f->dh.h.offset;
+}
+
 int _mrs_replace_file(MRS* mrs, struct mrs_file_t* oldf, struct mrs_file_t* newf){
     if(!mrs)
         return MRSE_UNITIALIZED;
     if(!oldf || !newf)
         return MRSE_INVALID_PARAM;
     
+    _mrs_cache_drop(mrs, oldf);
+    _mrs_temp_release(mrs, oldf);
+    _mrs_source_release(mrs, oldf->src);
+    _mrs_index_remove(mrs, oldf - mrs->_files);
     _mrs_file_free(oldf);
     memcpy(oldf, newf, sizeof(struct mrs_file_t));
+    _mrs_index_add(mrs, oldf - mrs->_files);
 
     return MRSE_OK;
 }
@@ -302,5 +476,7 @@ const char* mrs_error_str[] = {
     "Cannot save file.",
     "Empty MRS file.",
     "No more files.",
-    "Cannot uncompress file."
+    "Cannot uncompress file.",
+    "Operation not supported for this file.",
+    "Saved data doesn't match the handle anymore."
 };
\ No newline at end of file
@@ -0,0 +1,318 @@
+/***************************************************************
+    libmrs
+    Easily manage GunZ: The Duel's .MRS archives
+    by Wes (@jwesy0), 2025
+***************************************************************/
+
+#define __LIBMRS_INTERNAL__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mrs.h"
+#include "mrs_error.h"
+
+#include "mrs_internal.h"
+#include "mrs_dbg.h"
+
+       /// FROM mrs_util.c
+extern int _mrs_is_initialized(const MRS* mrs);
+       /// FROM mrs_index.c
+extern uint32_t _mrs_name_hash(const char* s);
+       /// FROM mrs_index.c
+extern uint32_t _mrs_name_hash_from(uint32_t h, const char* s);
+       /// FROM mrs_index.c
+extern int _mrs_name_eq(const char* a, const char* b);
+       /// FROM mrs_index.c
+extern int _mrs_name_cmp(const char* a, const char* b, size_t n);
+
+/**< Smallest number of slots of the table */
+#define MRS_VFS_MIN 64
+
+/**< Hash of file `i` of `m`, as it is named in the VFS. */
+static uint32_t _mrs_vfs_hash(const struct mrs_vfs_mount_t* m, unsigned i){
+    return _mrs_name_hash_from(m->point_hash, m->mrs->_files[i].dh.filename);
+}
+
+/**< `1` if `s` is the name of file `i` of `m` in the VFS. */
+static int _mrs_vfs_eq(const struct mrs_vfs_mount_t* m, unsigned i, const char* s){
+    if(i >= m->mrs->_hdr.dir_count)
+        return 0;
+
+    return !_mrs_name_cmp(s, m->point, m->point_len) && _mrs_name_eq(s + m->point_len, m->mrs->_files[i].dh.filename);
+}
+
+/**< `1` if file `ai` of mount `a` hides file `bi` of mount `b` (both one-based). */
+static int _mrs_vfs_wins(const struct mrs_vfs_t* v, unsigned a, unsigned ai, unsigned b, unsigned bi){
+    const struct mrs_vfs_mount_t* ma = &v->mounts[a - 1];
+    const struct mrs_vfs_mount_t* mb = &v->mounts[b - 1];
+
+    if(ma->priority != mb->priority)
+        return ma->priority > mb->priority;
+    if(ma->seq != mb->seq)
+        return ma->seq > mb->seq;
+
+    // Same handle, the first file of that name wins as in `mrs_find_file`
+    return ai < bi;
+}
+
+static void _mrs_vfs_put(struct mrs_vfs_t* v, uint32_t h, unsigned mount, unsigned index){
+    size_t s;
+
+    for(s = h & (v->cap - 1); v->slots[s].mount; s = (s + 1) & (v->cap - 1));
+
+    v->slots[s].hash  = h;
+    v->slots[s].mount = mount;
+    v->slots[s].index = index;
+    v->used++;
+}
+
+/**< Moves the table of `v` to one with room for `n` names, leaving out the ones of mount `skip` (one-based, `0` for none). */
+static int _mrs_vfs_rehash(struct mrs_vfs_t* v, size_t n, unsigned skip){
+    struct mrs_vfs_slot_t* old = v->slots;
+    size_t old_cap = v->cap, cap = MRS_VFS_MIN, i;
+
+    // At most half full, so probes stay short
+    while(cap < n * 2)
+        cap *= 2;
+
+    v->slots = (struct mrs_vfs_slot_t*)calloc(cap, sizeof(struct mrs_vfs_slot_t));
+    if(!v->slots){
+        v->slots = old;
+        return 0;
+    }
+    v->cap  = cap;
+    v->used = 0;
+
+    for(i=0; i<old_cap; i++){
+        if(old[i].mount && old[i].mount != skip)
+            _mrs_vfs_put(v, old[i].hash, old[i].mount, old[i].index);
+    }
+    free(old);
+
+    return 1;
+}
+
+/**< Takes file `index` of mount `mount` (one-based) out of the table of `v`, `0` if it isn't there. */
+static int _mrs_vfs_del(struct mrs_vfs_t* v, uint32_t h, unsigned mount, unsigned index){
+    size_t s, e, home;
+
+    if(!v->cap)
+        return 0;
+
+    for(s = h & (v->cap - 1); v->slots[s].mount; s = (s + 1) & (v->cap - 1)){
+        if(v->slots[s].mount == mount && v->slots[s].index == index)
+            break;
+    }
+    if(!v->slots[s].mount)
+        return 0;
+
+    // Moves back whatever comes after it and would not be found anymore with the gap
+    for(e = (s + 1) & (v->cap - 1); v->slots[e].mount; e = (e + 1) & (v->cap - 1)){
+        home = v->slots[e].hash & (v->cap - 1);
+        if(((e - home) & (v->cap - 1)) >= ((e - s) & (v->cap - 1))){
+            v->slots[s] = v->slots[e];
+            s = e;
+        }
+    }
+    v->slots[s].mount = 0;
+    v->used--;
+
+    return 1;
+}
+
+static int _mrs_vfs_mount(MRS_VFS* vfs, const MRS* mrs, MRS* owned, const char* mount_point, int priority){
+    struct mrs_vfs_mount_t* mounts;
+    struct mrs_vfs_mount_t* m;
+    size_t   k, len;
+    unsigned i;
+
+    len = mount_point ? strlen(mount_point) : 0;
+
+    for(k=0; k<vfs->nmounts && vfs->mounts[k].mrs; k++);
+    if(k == vfs->nmounts){
+        mounts = (struct mrs_vfs_mount_t*)realloc(vfs->mounts, (vfs->nmounts + 1) * sizeof(struct mrs_vfs_mount_t));
+        if(!mounts)
+            return MRSE_INSUFFICIENT_MEM;
+        vfs->mounts = mounts;
+        memset(&vfs->mounts[k], 0, sizeof(struct mrs_vfs_mount_t));
+        vfs->nmounts++;
+    }
+    m = &vfs->mounts[k];
+
+    // The table only grows when it would be more than half full, otherwise the names just go in
+    m->point = (char*)malloc(len + 2);
+    if(!m->point || ((vfs->used + mrs->_hdr.dir_count) * 2 > vfs->cap && !_mrs_vfs_rehash(vfs, vfs->used + mrs->_hdr.dir_count, 0))){
+        free(m->point);
+        m->point = NULL;
+        return MRSE_INSUFFICIENT_MEM;
+    }
+    strcpy(m->point, len ? mount_point : "");
+    if(len && mount_point[len - 1] != '/' && mount_point[len - 1] != '\\')
+        m->point[len++] = '/';
+    m->point[len] = 0;
+
+    m->mrs        = mrs;
+    m->owned      = owned;
+    m->priority   = priority;
+    m->seq        = ++vfs->seq;
+    m->point_len  = len;
+    m->point_hash = _mrs_name_hash(m->point);
+    m->count      = mrs->_hdr.dir_count;
+
+    for(i=0; i<mrs->_hdr.dir_count; i++)
+        _mrs_vfs_put(vfs, _mrs_vfs_hash(m, i), k + 1, i);
+
+    dbgprintf("Mounted %u file(s) at \"%s\" with priority %d, %u name(s) in total", m->count, m->point, priority, vfs->used);
+
+    return MRSE_OK;
+}
+
+MRS_VFS* mrs_vfs_init(){
+    MRS_VFS* vfs;
+
+    vfs = (MRS_VFS*)calloc(1, sizeof(struct mrs_vfs_t));
+    if(!vfs){
+        dbgprintf("Could not allocate vfs");
+    }
+
+    return vfs;
+}
+
+int mrs_vfs_mount(MRS_VFS* vfs, const MRS* mrs, const char* mount_point, int priority){
+    size_t k;
+
+    if(!vfs)
+        return MRSE_INVALID_PARAM;
+
+    if(!_mrs_is_initialized(mrs))
+        return MRSE_UNITIALIZED;
+
+    for(k=0; k<vfs->nmounts; k++){
+        if(vfs->mounts[k].mrs == mrs)
+            return MRSE_DUPLICATE;
+    }
+
+    return _mrs_vfs_mount(vfs, mrs, NULL, mount_point, priority);
+}
+
+int mrs_vfs_mount_file(MRS_VFS* vfs, const char* mrsname, const char* mount_point, int priority, const MRS** mrs){
+    MRS* m;
+    int  r;
+
+    if(!vfs || !mrsname)
+        return MRSE_INVALID_PARAM;
+
+    m = mrs_init();
+    if(!m)
+        return MRSE_INSUFFICIENT_MEM;
+
+    // Mounted archives are only read from, so there's no need to copy anything
+    mrs_set_flags(m, MRSF_MMAP | MRSF_TRUST_CDIR);
+    r = mrs_add(m, MRSA_MRS, MRSDB_KEEP_BOTH, NULL, mrsname, NULL);
+    if(r == MRSE_OK)
+        r = _mrs_vfs_mount(vfs, m, m, mount_point, priority);
+    if(r != MRSE_OK){
+        mrs_free(m);
+        return r;
+    }
+
+    if(mrs)
+        *mrs = m;
+
+    return MRSE_OK;
+}
+
+int mrs_vfs_unmount(MRS_VFS* vfs, const MRS* mrs){
+    struct mrs_vfs_mount_t* m;
+    size_t   k, n = 0;
+    unsigned i;
+
+    if(!vfs || !mrs)
+        return MRSE_INVALID_PARAM;
+
+    for(k=0; k<vfs->nmounts && vfs->mounts[k].mrs != mrs; k++);
+    if(k == vfs->nmounts)
+        return MRSE_NOT_FOUND;
+    m = &vfs->mounts[k];
+
+    for(i=0; i<m->count && i<mrs->_hdr.dir_count; i++)
+        n += _mrs_vfs_del(vfs, _mrs_vfs_hash(m, i), k + 1, i);
+
+    // The handle was changed while mounted, what's left of it can only be found by going through everything
+    if(n < m->count){
+        dbgprintf("Only %u of %u name(s) found, dropping the rest", n, m->count);
+        if(!_mrs_vfs_rehash(vfs, vfs->used, k + 1))
+            return MRSE_INSUFFICIENT_MEM;
+    }
+
+    dbgprintf("Unmounted \"%s\", %u name(s) left", m->point, vfs->used);
+
+    free(m->point);
+    if(m->owned)
+        mrs_free(m->owned);
+    memset(m, 0, sizeof(struct mrs_vfs_mount_t));
+
+    return MRSE_OK;
+}
+
+int mrs_vfs_find(const MRS_VFS* vfs, const char* name, const MRS** mrs, unsigned* index){
+    const struct mrs_vfs_slot_t* best = NULL;
+    const struct mrs_vfs_slot_t* sl;
+    uint32_t h;
+    size_t   s;
+
+    if(!vfs || !name)
+        return MRSE_INVALID_PARAM;
+
+    if(!vfs->cap)
+        return MRSE_NOT_FOUND;
+
+    h = _mrs_name_hash(name);
+    for(s = h & (vfs->cap - 1); vfs->slots[s].mount; s = (s + 1) & (vfs->cap - 1)){
+        sl = &vfs->slots[s];
+        if(sl->hash != h || (best && !_mrs_vfs_wins(vfs, sl->mount, sl->index, best->mount, best->index)))
+            continue;
+        if(_mrs_vfs_eq(&vfs->mounts[sl->mount - 1], sl->index, name))
+            best = sl;
+    }
+
+    if(!best)
+        return MRSE_NOT_FOUND;
+
+    if(mrs)
+        *mrs = vfs->mounts[best->mount - 1].mrs;
+    if(index)
+        *index = best->index;
+
+    return MRSE_OK;
+}
+
+int mrs_vfs_read(const MRS_VFS* vfs, const char* name, unsigned char* buf, size_t buf_size, size_t* out_size){
+    const MRS* mrs;
+    unsigned   index;
+    int        r;
+
+    r = mrs_vfs_find(vfs, name, &mrs, &index);
+    if(r != MRSE_OK)
+        return r;
+
+    return mrs_read(mrs, index, buf, buf_size, out_size);
+}
+
+void mrs_vfs_free(MRS_VFS* vfs){
+    size_t k;
+
+    if(!vfs)
+        return;
+
+    for(k=0; k<vfs->nmounts; k++){
+        free(vfs->mounts[k].point);
+        if(vfs->mounts[k].owned)
+            mrs_free(vfs->mounts[k].owned);
+    }
+    free(vfs->mounts);
+    free(vfs->slots);
+    free(vfs);
+}
@@ -9,9 +9,18 @@
 #include <string.h>
 #include <ctype.h>
 #include <windows.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
 
 #include "zlib.h"
 
+#ifdef _MSC_VER
+#define MRS_THREAD_LOCAL __declspec(thread)
+#else
+#define MRS_THREAD_LOCAL __thread
+#endif
+
 #ifdef _LIBMRS_DBG
 #define _dbgprintf(...) printf(__VA_ARGS__);
 #define dbgprintf(...) printf("%s: ", __FUNCTION__); \
@@ -79,9 +88,8 @@ int _strbkslash(char* s, size_t size){
   unsigned i = 0;
   int r = 1;
   
-  while(*(s+i)){
-    if(size && i>=size)
-      break;
+  // With a `size`, `s` may not end in a null character, so nothing past it is looked at
+  while((!size || i<size) && *(s+i)){
     if(*(s+i) == '/'){
       *(s+i) = '\\';
       r = 0;
@@ -258,71 +266,190 @@ int _is_valid_input_filename(const char* s){
   return 0; // Valid file name
 }
 
-int _uncompress_file(unsigned char* inbuf, size_t total_in, unsigned char* outbuf, size_t uncompressed_size, size_t* out_size){
-    z_stream zstream;
-    int e;
+/*
+    zlib streams of each thread, set up once and reset between files,
+    since for small files setting them up costs more than the (de)compression itself
+*/
+static MRS_THREAD_LOCAL z_stream _inflater;
+static MRS_THREAD_LOCAL int      _inflater_ready;
+static MRS_THREAD_LOCAL z_stream _deflater;
+static MRS_THREAD_LOCAL int      _deflater_ready;
+/**< Level and strategy `_deflater` is set to. */
+static MRS_THREAD_LOCAL int      _deflater_level;
+static MRS_THREAD_LOCAL int      _deflater_strategy;
+
+       /// FROM mrs_compress.c
+extern void _mrs_codec_thread_cleanup();
+
+/*
+    Threads that kept streams (or codec objects) are told apart by a key with a destructor,
+    so whatever they kept is freed when they exit, even if mrs_thread_cleanup() was never called
+*/
+#ifdef _WIN32
+static DWORD          _thread_key  = FLS_OUT_OF_INDEXES;
+static INIT_ONCE      _thread_once = INIT_ONCE_STATIC_INIT;
+#else
+static pthread_key_t  _thread_key;
+static int            _thread_key_ready;
+static pthread_once_t _thread_once = PTHREAD_ONCE_INIT;
+#endif
+static MRS_THREAD_LOCAL int _thread_registered;
+
+void _mrs_thread_cleanup();
+
+#ifdef _WIN32
+static VOID WINAPI _mrs_thread_exit(PVOID param){
+#else
+static void _mrs_thread_exit(void* param){
+#endif
+    _mrs_thread_cleanup();
+    _mrs_codec_thread_cleanup();
+}
+
+#ifdef _WIN32
+static BOOL CALLBACK _mrs_thread_key_init(PINIT_ONCE once, PVOID param, PVOID* context){
+    _thread_key = FlsAlloc(_mrs_thread_exit);
+    return TRUE;
+}
+#else
+static void _mrs_thread_key_init(){
+    _thread_key_ready = !pthread_key_create(&_thread_key, _mrs_thread_exit);
+}
+#endif
+
+/**< Has what the calling thread keeps freed when it exits, called whenever it sets something up. */
+void _mrs_thread_register(){
+    if(_thread_registered)
+        return;
+#ifdef _WIN32
+    InitOnceExecuteOnce(&_thread_once, _mrs_thread_key_init, NULL, NULL);
+    _thread_registered = _thread_key != FLS_OUT_OF_INDEXES && FlsSetValue(_thread_key, (PVOID)1);
+#else
+    pthread_once(&_thread_once, _mrs_thread_key_init);
+    _thread_registered = _thread_key_ready && !pthread_setspecific(_thread_key, (void*)1);
+#endif
+}
 
-    zstream.zalloc = Z_NULL;
-    zstream.zfree  = Z_NULL;
-    zstream.opaque = Z_NULL;
-    zstream.next_in   = (Bytef*)inbuf;
-    zstream.avail_in  = total_in;
-    zstream.next_out  = (Bytef*)outbuf;
-    zstream.avail_out = uncompressed_size;
+/**< Raw inflate stream of the calling thread, ready for a new file. */
+z_stream* _mrs_inflater(){
+    if(_inflater_ready){
+        if(inflateReset(&_inflater) == Z_OK){
+            _inflater.next_in  = Z_NULL;
+            _inflater.avail_in = 0;
+            return &_inflater;
+        }
+        inflateEnd(&_inflater);
+        _inflater_ready = 0;
+    }
+
+    memset(&_inflater, 0, sizeof(z_stream));
+    _inflater.zalloc = Z_NULL;
+    _inflater.zfree  = Z_NULL;
+    _inflater.opaque = Z_NULL;
+    if(inflateInit2(&_inflater, -MAX_WBITS) != Z_OK)
+        return NULL;
+
+    _mrs_thread_register();
+    _inflater_ready = 1;
+    return &_inflater;
+}
+
+/**< Raw deflate stream of the calling thread, ready for a new file with `level` and `strategy`. */
+z_stream* _mrs_deflater(int level, int strategy){
+    if(_deflater_ready){
+        // Other parameters make a new stream, deflateParams() may write an empty block on some zlib versions
+        if(level == _deflater_level && strategy == _deflater_strategy && deflateReset(&_deflater) == Z_OK){
+            _deflater.next_in  = Z_NULL;
+            _deflater.avail_in = 0;
+            return &_deflater;
+        }
+        deflateEnd(&_deflater);
+        _deflater_ready = 0;
+    }
+
+    memset(&_deflater, 0, sizeof(z_stream));
+    _deflater.zalloc = Z_NULL;
+    _deflater.zfree  = Z_NULL;
+    _deflater.opaque = Z_NULL;
+    if(deflateInit2(&_deflater, level, Z_DEFLATED, -MAX_WBITS, 9, strategy) != Z_OK)
+        return NULL;
+
+    _mrs_thread_register();
+    _deflater_ready    = 1;
+    _deflater_level    = level;
+    _deflater_strategy = strategy;
+    return &_deflater;
+}
+
+/**< Frees the zlib streams of the calling thread. */
+void _mrs_thread_cleanup(){
+    if(_inflater_ready)
+        inflateEnd(&_inflater);
+    if(_deflater_ready)
+        deflateEnd(&_deflater);
+    _inflater_ready = 0;
+    _deflater_ready = 0;
+}
 
-    e = inflateInit2(&zstream, -MAX_WBITS);
-    if(e != Z_OK)
+/**< Inflates raw DEFLATE `inbuf` into `outbuf`, `0` if it comes out exactly `uncompressed_size` bytes (the zlib codec). */
+int _uncompress_file(const unsigned char* inbuf, size_t total_in, unsigned char* outbuf, size_t uncompressed_size){
+    z_stream* zstream;
+    int e;
+
+    zstream = _mrs_inflater();
+    if(!zstream)
         return 1;
-    
-    e = inflate(&zstream, Z_FINISH);
-    if(e != Z_STREAM_END)
+
+    zstream->next_in   = (Bytef*)inbuf;
+    zstream->avail_in  = total_in;
+    zstream->next_out  = (Bytef*)outbuf;
+    zstream->avail_out = uncompressed_size;
+
+    e = inflate(zstream, Z_FINISH);
+    if(e != Z_STREAM_END || zstream->total_out != uncompressed_size)
         return 1;
     
-    dbgprintf("File inflated from %u bytes to %u", total_in, zstream.total_out);
-    if(out_size)
-        *out_size = zstream.total_out;
-
-    inflateEnd(&zstream);
+    dbgprintf("File inflated from %u bytes to %u", total_in, zstream->total_out);
 
     return 0;
 }
 
-int _compress_file(unsigned char* inbuf, size_t total_in, unsigned char** outbuf, size_t* total_out){
-    z_stream zstream;
+/**
+ * Deflates `inbuf` into `outbuf` as raw DEFLATE (the zlib codec), returns the compressed size, `0` if it can't or it
+ * doesn't fit in `out_size` bytes. If `probe` isn't `0`, gives up after the first `probe` bytes if they didn't get
+ * down to `probe_ratio`% or less.
+ */
+size_t _compress_file(const unsigned char* inbuf, size_t total_in, unsigned char* outbuf, size_t out_size, int level, int strategy, size_t probe, unsigned probe_ratio){
+    z_stream* zstream;
     int e;
 
-    *outbuf = (unsigned char*)malloc(total_in + 16);
-    if(!(*outbuf))
+    zstream = _mrs_deflater(level, strategy);
+    if(!zstream)
         return 0;
 
-    zstream.zalloc = Z_NULL;
-    zstream.zfree  = Z_NULL;
-    zstream.opaque = Z_NULL;
-    zstream.next_in   = (Bytef*)inbuf;
-    zstream.avail_in  = total_in;
-    zstream.next_out  = (Bytef*)*outbuf;
-    zstream.avail_out = total_in + 16;
-
-    e = deflateInit2(&zstream, 9, Z_DEFLATED, -MAX_WBITS, 9, Z_DEFAULT_STRATEGY);
-    if(e != Z_OK){
-        free(*outbuf);
-        *outbuf = NULL;
-        return 0;
-    }
+    zstream->next_in   = (Bytef*)inbuf;
+    zstream->avail_in  = total_in;
+    zstream->next_out  = (Bytef*)outbuf;
+    zstream->avail_out = out_size;
 
-    e = deflate(&zstream, Z_FINISH);
-    if(e != Z_STREAM_END){
-        free(*outbuf);
-        *outbuf = NULL;
-        return 0;
+    // Deflate makes the same output whichever way the input is split, as long as nothing is flushed in between
+    if(probe && probe < total_in){
+        zstream->avail_in = probe;
+        e = deflate(zstream, Z_NO_FLUSH);
+        if(e != Z_OK || (unsigned long long)zstream->total_out * 100 > (unsigned long long)zstream->total_in * probe_ratio){
+            dbgprintf("First %u bytes only got down to %u, giving up", zstream->total_in, zstream->total_out);
+            return 0;
+        }
+        zstream->avail_in = total_in - zstream->total_in;
     }
 
-    dbgprintf("File compressed: from %u bytes to %u bytes", total_in, zstream.total_out);
-    (*total_out) = zstream.total_out;
+    e = deflate(zstream, Z_FINISH);
+    if(e != Z_STREAM_END)
+        return 0;
 
-    deflateEnd(&zstream);
+    dbgprintf("File compressed: from %u bytes to %u bytes", total_in, zstream->total_out);
 
-    return 1;
+    return zstream->total_out;
 }
 
 int _mkdirs(const char* s){